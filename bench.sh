@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Build the latest program, with optimizations
+mkdir -p build
+cmake -S. -B./build -DCMAKE_BUILD_TYPE=Release
+cmake --build ./build
+
+# Generate a large instance, once
+BENCH_INPUT=${BENCH_INPUT:-/tmp/ex3-bench.txt}
+if [ ! -f "$BENCH_INPUT" ]; then
+  awk 'BEGIN {
+    srand(1); n = 1000000; m = 5000000;
+    print n, m;
+    for (i = 0; i < m; i++) {
+      printf "%d %d %d %s\n", 1 + int(rand() * n), 1 + int(rand() * n), 1 + int(rand() * 10000), rand() < 0.5 ? "red" : "blue";
+    }
+  }' > "$BENCH_INPUT"
+fi
+
+echo "--- RUNNING BENCHMARKS ... ---"
+for size in 65536 0; do
+  echo "buffer size: $size (0 sizes it from the input)"
+  time ./build/ex3 --stats --buffer-size $size < "$BENCH_INPUT"
+  echo "from a pipe:"
+  time (cat "$BENCH_INPUT" | ./build/ex3 --stats --buffer-size $size)
+done
+
+# The same kind of instance with floating-point costs, nearly all distinct, which go through the rank-space compression
+FLOAT_INPUT=${FLOAT_INPUT:-/tmp/ex3-float.txt}
+if [ ! -f "$FLOAT_INPUT" ]; then
+  awk 'BEGIN {
+    srand(3); n = 1000000; m = 3000000;
+    print n, m;
+    for (i = 0; i < m; i++) {
+      printf "%d %d %.6f %s\n", 1 + int(rand() * n), 1 + int(rand() * n), (rand() - 0.3) * 1000, rand() < 0.5 ? "red" : "blue";
+    }
+  }' > "$FLOAT_INPUT"
+fi
+echo "floating-point costs:"
+time ./build/ex3 < "$FLOAT_INPUT"
+
+# A dense instance, with 80 bridges per island, for the engines which don't sort
+DENSE_INPUT=${DENSE_INPUT:-/tmp/ex3-dense.txt}
+if [ ! -f "$DENSE_INPUT" ]; then
+  awk 'BEGIN {
+    srand(2); n = 50000; m = 4000000;
+    print n, m;
+    for (i = 0; i < m; i++) {
+      printf "%d %d %d %s\n", 1 + int(rand() * n), 1 + int(rand() * n), 1 + int(rand() * 10000), rand() < 0.5 ? "red" : "blue";
+    }
+  }' > "$DENSE_INPUT"
+fi
+for engine in kruskal boruvka kkt; do
+  echo "engine: $engine"
+  time ./build/ex3 --engine $engine < "$DENSE_INPUT"
+done
+echo "--- DONE ! ---"
@@ -1,8 +1,25 @@
+#include <limits.h>
+#include <math.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 /*
  * Some GCC-specific macros which help indicate to the compiler whether some expressions are expected to give a certain
@@ -52,6 +69,147 @@ void uf_union_r(uf_item_t *items, int ur, int vr) {
   }
 }
 
+/*
+ * With hundreds of millions of islands, nearly every find touches another page, and misses the TLB. Large union-find
+ * arrays are thus mapped on huge pages: 1 GiB or 2 MiB pages reserved by the system when there are some, or else
+ * transparent huge pages, which the kernel is asked to use for the mapping. Each array starts with a header recording
+ * how it was allocated, so it can be released the same way.
+ */
+
+#define UF_HUGE_MIN (2 * 1024 * 1024)   // The size from which a union-find array is mapped on huge pages.
+#define UF_HUGE_2M (2 * 1024 * 1024)
+#define UF_HUGE_1G (1024 * 1024 * 1024)
+#define UF_PREFETCH 16                  // How many bridges ahead Kruskal's algorithm prefetches their islands.
+
+/**
+ * How a union-find array was allocated.
+ */
+typedef enum uf_pages {
+  UF_PAGES_HEAP,          // With malloc.
+  UF_PAGES_TRANSPARENT,   // Mapped, with transparent huge pages requested.
+  UF_PAGES_HUGE_2M,       // Mapped on reserved 2 MiB pages.
+  UF_PAGES_HUGE_1G,       // Mapped on reserved 1 GiB pages.
+} uf_pages_t;
+
+static const char *uf_pages_names[] = {"heap", "transparent huge pages", "2 MiB huge pages", "1 GiB huge pages"};
+
+// Whether large union-find arrays may be mapped on huge pages.
+bool uf_huge_pages = true;
+
+// How the largest union-find array so far was allocated, for the statistics.
+atomic_int uf_pages_largest = UF_PAGES_HEAP;
+atomic_size_t uf_size_largest = 0;
+
+/**
+ * The header in front of each union-find array, padded so the items stay aligned on a cache line.
+ */
+typedef union uf_header {
+  struct {
+    size_t length;      // The length of the mapping.
+    uf_pages_t pages;
+  };
+  max_align_t padding[64 / sizeof(max_align_t)];
+} uf_header_t;
+
+/**
+ * Maps some memory, rounded up to a whole number of pages of the given size.
+ *
+ * @return the memory, or NULL if it could not be mapped.
+ */
+static void *uf_map(size_t *length, size_t page, int flags) {
+  *length = (*length + page - 1) / page * page;
+  void *memory = mmap(NULL, *length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return memory == MAP_FAILED ? NULL : memory;
+}
+
+/**
+ * Allocates a union-find array of n items, on huge pages if it is large enough and some are available.
+ *
+ * @return the array, or NULL if we ran out of memory.
+ */
+uf_item_t *uf_alloc(int n) {
+  size_t size = sizeof(uf_header_t) + sizeof(uf_item_t) * (size_t) (n > 0 ? n : 0);
+  size_t length = size;
+  uf_pages_t pages = UF_PAGES_HEAP;
+  uf_header_t *header = NULL;
+  if (uf_huge_pages && size >= UF_HUGE_MIN) {
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_1GB)
+    if (size >= UF_HUGE_1G / 2 && (header = uf_map(&length, UF_HUGE_1G, MAP_HUGETLB | MAP_HUGE_1GB)) != NULL) {
+      pages = UF_PAGES_HUGE_1G;
+    }
+#endif
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_2MB)
+    if (header == NULL && (length = size, header = uf_map(&length, UF_HUGE_2M, MAP_HUGETLB | MAP_HUGE_2MB)) != NULL) {
+      pages = UF_PAGES_HUGE_2M;
+    }
+#endif
+    if (header == NULL && (length = size, header = uf_map(&length, UF_HUGE_2M, 0)) != NULL) {
+#ifdef MADV_HUGEPAGE
+      madvise(header, length, MADV_HUGEPAGE);
+#endif
+      pages = UF_PAGES_TRANSPARENT;
+    }
+  }
+  if (header == NULL && (header = malloc(size)) == NULL) return NULL;
+  header->length = length;
+  header->pages = pages;
+
+  size_t largest = atomic_load(&uf_size_largest);
+  while (largest < size && !atomic_compare_exchange_weak(&uf_size_largest, &largest, size));
+  if (largest < size) atomic_store(&uf_pages_largest, pages);
+  return (uf_item_t *) (header + 1);
+}
+
+/**
+ * Releases a union-find array allocated with uf_alloc.
+ */
+void uf_free(uf_item_t *uf) {
+  if (uf == NULL) return;
+  uf_header_t *header = (uf_header_t *) uf - 1;
+  if (header->pages == UF_PAGES_HEAP) {
+    free(header);
+  } else {
+    munmap(header, header->length);
+  }
+}
+
+/**
+ * Starts counting the data TLB misses of the loads of the process, so that the gain of the huge pages can be measured
+ * by comparing with a run under --no-huge-pages.
+ *
+ * @return the file descriptor of the counter, or -1 if the system does not let us count them.
+ */
+int uf_tlb_counter_open(void) {
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+/**
+ * Prints how the largest union-find array was allocated, and the data TLB misses counted so far.
+ */
+void uf_print_stats(int counter, FILE *file) {
+  fprintf(file, "union-find: %zu bytes on %s\n", atomic_load(&uf_size_largest),
+          uf_pages_names[atomic_load(&uf_pages_largest)]);
+  unsigned long long misses;
+  if (counter >= 0 && read(counter, &misses, sizeof(misses)) == sizeof(misses)) {
+    fprintf(file, "dTLB load misses: %llu\n", misses);
+  } else {
+    fprintf(file, "dTLB load misses: unavailable\n");
+  }
+}
+
 /*
  * The masks we'll be using in order to implement radix sorting on the bridges. The cost is bound between 1 and 10'000,
  * meaning we know that only the 14 LSB will be used. However, shorts consist of at least 16 bits, so we can use the
@@ -59,22 +217,48 @@ void uf_union_r(uf_item_t *items, int ur, int vr) {
  *
  * When calculating the total cost, it's important to apply the MASK_COST before adding the elements, in order to avoid
  * incorrect computations due to the MARK bit remaining.
+ *
+ * Costs which do not fit in the mask are first compressed to their rank amongst the distinct costs of the input (see
+ * the rank-space compression below), in which case the mark bit is moved just above the largest rank.
  */
 #define BRIDGE_MASK_COST 0x3FFF
 #define BRIDGE_MARK_RED 0x1 << 14
+#define BRIDGE_RED_SHIFT 14   // The position of the BRIDGE_MARK_RED bit.
 
 /**
  * A bridge that can be built between two islands, at a given cost, and by a certain company.
+ *
+ * The bridges of equal key are taken in the order of the input: whatever the engine and the number of threads, the
+ * forest is the one Kruskal's algorithm builds from the bridges sorted by decreasing key, then by increasing index.
  */
 typedef struct bridge {
-  int_fast32_t from, to;
-  int_fast16_t cost;
+  int32_t from, to;
+  uint32_t cost;
+  uint32_t index;   // The position of the bridge in the input.
 } bridge_t;
 
+// PREFIX SUMS
+
+/**
+ * Replaces some counts by their exclusive prefix sums: each count becomes the sum of the counts before it.
+ *
+ * @return the sum of all the counts.
+ */
+int prefix_sum(size_t count, int values[count]) {
+  int sum = 0;
+  for (size_t i = 0; i < count; ++i) {
+    int value = values[i];
+    values[i] = sum;
+    sum += value;
+  }
+  return sum;
+}
+
 // RADIX SORT FOR BRIDGES
 
 #define RADIX_BITS   8                        // How many bits are in each byte.
 #define RADIX_LEVELS (sizeof(int16_t))        // The number of radix iterations we have to perform. Only use 16 LSB.
+#define RADIX_LEVELS_MAX (sizeof(int32_t))    // The number of radix iterations needed for any rank-compressed cost.
 #define RADIX_SIZE   (1 << RADIX_BITS)        // The number of bins for each radix step.
 #define RADIX_MASK   (RADIX_SIZE - 1)         // The mask to apply on each radix step.
 
@@ -83,13 +267,14 @@ typedef struct bridge {
  * radix level.
  *
  * @param m the number of bridges.
+ * @param levels the number of radix levels to count.
  * @param bridges the bridges for which we're computing frequencies.
  * @param frequencies the frequencies table to which we're writing.
  */
-void radix_compute_frequencies(size_t m, bridge_t bridges[m], int frequencies[RADIX_LEVELS][RADIX_SIZE]) {
+void radix_compute_frequencies(size_t m, int levels, bridge_t bridges[m], int frequencies[RADIX_LEVELS_MAX][RADIX_SIZE]) {
   for (int i = 0; i < m; ++i) {
-    uint_fast16_t cost = bridges[i].cost;
-    for (int l = 0; l < RADIX_LEVELS; ++l) {
+    uint_fast32_t cost = bridges[i].cost;
+    for (int l = 0; l < levels; ++l) {
       frequencies[l][cost & RADIX_MASK]++;
       cost = cost >> RADIX_BITS;
     }
@@ -104,171 +289,4291 @@ void radix_compute_frequencies(size_t m, bridge_t bridges[m], int frequencies[RA
  * @param frequencies the frequency counts.
  * @param indices the indices that will be returned.
  */
-void radix_compute_indices(int level, int frequencies[RADIX_LEVELS][RADIX_SIZE], int indices[RADIX_LEVELS]) {
-  int index = 0;
-  for (int i = 0; i < RADIX_SIZE; i++) {
-    indices[i] = index;
-    index += frequencies[level][i];
+void radix_compute_indices(int level, int frequencies[RADIX_LEVELS_MAX][RADIX_SIZE], int indices[RADIX_SIZE]) {
+  memcpy(indices, frequencies[level], sizeof(int) * RADIX_SIZE);
+  prefix_sum(RADIX_SIZE, indices);
+}
+
+/**
+ * Computes the indices table for a reversed radix pass, which fills each queue down from the index after its end.
+ *
+ * The first pass of a sort is reversed, so the bridges of equal digit come out in the opposite order of the input, and
+ * the later passes are stable: the bridges of equal key end up by decreasing index, and Kruskal's algorithm, which
+ * scans them from the end, takes them by increasing index.
+ */
+void radix_compute_ends(int level, int frequencies[RADIX_LEVELS_MAX][RADIX_SIZE], int indices[RADIX_SIZE]) {
+  radix_compute_indices(level, frequencies, indices);
+  for (int i = 0; i < RADIX_SIZE; i++) indices[i] += frequencies[level][i];
+}
+
+#define RADIX_STAGE_ITEMS 32            // The bridges staged for each queue before they are written out together.
+#define RADIX_STAGE_MIN (64 * 1024)     // The number of bridges from which the scatter stages its writes.
+
+#if defined(__SSE2__) && defined(__x86_64__)
+#include <emmintrin.h>
+#define RADIX_STREAM 1
+#endif
+
+/**
+ * Writes some staged bridges to their queue. When possible, the words are written with non-temporal stores, which go
+ * through the write-combining buffers instead of reading the destination lines into the cache first.
+ */
+static inline void radix_flush(bridge_t *to, const bridge_t *staged, size_t count) {
+#ifdef RADIX_STREAM
+  if (sizeof(bridge_t) % sizeof(long long) == 0) {
+    const char *source = (const char *) staged;
+    char *destination = (char *) to;
+    for (size_t w = 0; w < count * sizeof(bridge_t); w += sizeof(long long)) {
+      long long word;
+      memcpy(&word, source + w, sizeof(word));
+      _mm_stream_si64((long long *) (destination + w), word);
+    }
+    return;
   }
+#endif
+  memcpy(to, staged, sizeof(bridge_t) * count);
 }
 
 /**
- * Applies radix sorting to the given array of bridges. Radix may be considerably more cache-friendly than a
- * max-priority heap sort, hence why it might be preferred to obtain some good running times.
+ * Moves the bridges in the given range to their queue of the output buffer, for the given radix level.
+ *
+ * Writing each bridge straight to one of 256 queues touches a different page and cache line at almost every step, so
+ * large ranges are first staged in a small buffer per queue, which stay in cache, and each queue is then written a
+ * whole staging buffer at a time, with sequential non-temporal stores.
+ *
+ * @param begin the index of the first bridge to move.
+ * @param end the index after the last bridge to move.
+ * @param level the current radix level.
+ * @param from the bridges to move.
+ * @param to the output buffer.
+ * @param indices the next free index of each queue, which gets updated.
+ * @param reversed whether the indices are the ends of the queues, which are filled down (see radix_compute_ends).
+ */
+void radix_scatter(size_t begin, size_t end, int level, const bridge_t *from, bridge_t *to, int indices[RADIX_SIZE],
+                   bool reversed) {
+  if (end - begin < RADIX_STAGE_MIN) {
+    for (size_t i = begin; i < end; i++) {
+      bridge_t bridge = from[i];
+      int queue = (bridge.cost >> (level * RADIX_BITS)) & RADIX_MASK;
+      to[reversed ? --indices[queue] : indices[queue]++] = bridge;
+    }
+    return;
+  }
+
+  // A reversed pass fills the staging buffers down as well, so they are still written out in one piece.
+  static _Thread_local bridge_t staged[RADIX_SIZE][RADIX_STAGE_ITEMS];
+  uint8_t counts[RADIX_SIZE] = {0};
+  for (size_t i = begin; i < end; i++) {
+    bridge_t bridge = from[i];
+    int queue = (bridge.cost >> (level * RADIX_BITS)) & RADIX_MASK;
+    staged[queue][reversed ? RADIX_STAGE_ITEMS - 1 - counts[queue] : counts[queue]] = bridge;
+    if (++counts[queue] == RADIX_STAGE_ITEMS) {
+      if (reversed) indices[queue] -= RADIX_STAGE_ITEMS;
+      radix_flush(to + indices[queue], staged[queue], RADIX_STAGE_ITEMS);
+      if (!reversed) indices[queue] += RADIX_STAGE_ITEMS;
+      counts[queue] = 0;
+    }
+  }
+#ifdef RADIX_STREAM
+  _mm_sfence();
+#endif
+  for (int queue = 0; queue < RADIX_SIZE; queue++) {
+    if (reversed) {
+      indices[queue] -= counts[queue];
+      memcpy(to + indices[queue], staged[queue] + RADIX_STAGE_ITEMS - counts[queue], sizeof(bridge_t) * counts[queue]);
+    } else {
+      memcpy(to + indices[queue], staged[queue], sizeof(bridge_t) * counts[queue]);
+      indices[queue] += counts[queue];
+    }
+  }
+}
+
+/**
+ * Applies radix sorting to the given array of bridges, considering only the given number of radix levels of the costs.
  *
  * @param m the number of bridges which are to be sorted.
+ * @param levels the number of bytes of the costs which are significant.
  * @param bridges the bridges to sort.
+ * @param buffer a buffer of m bridges.
  */
-void radix_sort_increasing(size_t m, bridge_t bridges[m]) {
+void radix_sort_increasing_buffer(size_t m, int levels, bridge_t bridges[m], bridge_t buffer[m]) {
   if (m == 0) return;
-  int frequencies[RADIX_LEVELS][RADIX_SIZE] = {0};
-  int indices[RADIX_LEVELS] = {0};
-  bridge_t buffer[m];
+  int frequencies[RADIX_LEVELS_MAX][RADIX_SIZE] = {0};
+  int indices[RADIX_SIZE] = {0};
 
   bridge_t *from = bridges;
   bridge_t *to = buffer;
 
-  radix_compute_frequencies(m, from, frequencies);
-  for (int l = 0; l < RADIX_LEVELS; ++l) {
-    radix_compute_indices(l, frequencies, indices);
-    for (int i = 0; i < m; i++) {
-      bridge_t bridge = from[i];
-      int queue = (bridge.cost >> (l * RADIX_BITS)) & RADIX_MASK;
-      to[indices[queue]++] = bridge;
+  radix_compute_frequencies(m, levels, from, frequencies);
+  for (int l = 0; l < levels; ++l) {
+    if (l == 0) {
+      radix_compute_ends(l, frequencies, indices);
+    } else {
+      radix_compute_indices(l, frequencies, indices);
     }
+    radix_scatter(0, m, l, from, to, indices, l == 0);
     // Swap from and to.
     bridge_t *tmp = from;
     from = to;
     to = tmp;
   }
-  // If from is the original bridge, copy the results.
-  if (bridges == to) memcpy(from, to, sizeof(bridge_t) * m);
+  // If the results ended up in the buffer, copy them back.
+  if (bridges == to) memcpy(bridges, from, sizeof(bridge_t) * m);
+}
+
+/**
+ * Applies radix sorting to the given array of bridges, allocating the buffer it needs.
+ *
+ * @return false if we ran out of memory.
+ */
+bool radix_sort_increasing_levels(size_t m, int levels, bridge_t bridges[m]) {
+  bridge_t *buffer = malloc(sizeof(bridge_t) * (m + 1));
+  if (buffer == NULL) return false;
+  radix_sort_increasing_buffer(m, levels, bridges, buffer);
+  free(buffer);
+  return true;
+}
+
+/**
+ * Applies radix sorting to the given array of bridges. Radix may be considerably more cache-friendly than a
+ * max-priority heap sort, hence why it might be preferred to obtain some good running times.
+ *
+ * @param m the number of bridges which are to be sorted.
+ * @param bridges the bridges to sort.
+ * @return false if we ran out of memory.
+ */
+bool radix_sort_increasing(size_t m, bridge_t bridges[m]) {
+  return radix_sort_increasing_levels(m, RADIX_LEVELS, bridges);
+}
+
+// RANK-SPACE COST COMPRESSION
+
+/**
+ * The rank-space representation of the costs of some bridges. Each distinct cost is replaced by its rank amongst all
+ * the distinct costs, so the keys stay dense enough for the radix sort, and the original costs are kept in a table
+ * indexed by rank to compute the totals.
+ */
+typedef struct cost_ranks {
+  size_t count;             // The number of distinct costs.
+  uint_fast32_t mask_cost;  // The mask to apply on a key to retrieve the rank.
+  uint_fast32_t mark_red;   // The bit marking red bridges, right above the largest rank.
+  int levels;               // The number of radix levels needed to sort the keys.
+  uint64_t *values;         // The order-preserving keys of the original costs, indexed by rank.
+} cost_ranks_t;
+
+/**
+ * Maps a signed cost to an unsigned key with the same ordering.
+ */
+static inline uint64_t ranks_key_of_long(long long cost) {
+  return (uint64_t) cost ^ (UINT64_C(1) << 63);
+}
+
+/**
+ * Maps back an unsigned key obtained with ranks_key_of_long to its signed cost.
+ */
+static inline long long ranks_long_of_key(uint64_t key) {
+  return (long long) (key ^ (UINT64_C(1) << 63));
+}
+
+/**
+ * Maps a floating-point cost to an unsigned key with the same ordering. Positive numbers only need their sign bit set,
+ * while negative numbers have all their bits flipped, so larger magnitudes give smaller keys.
+ */
+static inline uint64_t ranks_key_of_double(double cost) {
+  uint64_t bits;
+  cost += 0.0; // Merge -0.0 and 0.0.
+  memcpy(&bits, &cost, sizeof(bits));
+  return (bits & (UINT64_C(1) << 63)) ? ~bits : bits | (UINT64_C(1) << 63);
+}
+
+/**
+ * Maps back an unsigned key obtained with ranks_key_of_double to its floating-point cost.
+ */
+static inline double ranks_double_of_key(uint64_t key) {
+  uint64_t bits = (key & (UINT64_C(1) << 63)) ? key ^ (UINT64_C(1) << 63) : ~key;
+  double cost;
+  memcpy(&cost, &bits, sizeof(cost));
+  return cost;
+}
+
+/**
+ * A distinct cost found while compressing, along with the order in which it was first seen.
+ */
+typedef struct cost_distinct {
+  uint64_t key;
+  int_fast32_t id;
+} cost_distinct_t;
+
+static int ranks_compare_distinct(const void *a, const void *b) {
+  uint64_t ka = ((const cost_distinct_t *) a)->key;
+  uint64_t kb = ((const cost_distinct_t *) b)->key;
+  return (ka > kb) - (ka < kb);
+}
+
+/**
+ * Compresses the given costs to rank space. Distinct costs are found with an open-addressing hash table, so only these
+ * have to be sorted, and the cost of each bridge is then replaced by its rank, keeping the red mark of the bridge.
+ *
+ * @param m the number of bridges.
+ * @param bridges the bridges, whose costs only carry the BRIDGE_MARK_RED bit on input and the rank key on output.
+ * @param keys the order-preserving keys of the original costs of the bridges.
+ * @param ranks the rank table that will be returned. Its values must be released with free().
+ * @return true if the compression succeeded, false if we ran out of memory.
+ */
+bool ranks_compress(size_t m, bridge_t bridges[m], const uint64_t keys[m], cost_ranks_t *ranks) {
+  size_t capacity = 2;
+  while (capacity < 2 * m) capacity <<= 1;
+  int shift = 64;
+  for (size_t c = capacity; c > 1; c >>= 1) --shift;
+
+  uint64_t *table_keys = malloc(sizeof(uint64_t) * capacity);
+  int_fast32_t *table_ids = malloc(sizeof(int_fast32_t) * capacity);
+  int_fast32_t *ids = malloc(sizeof(int_fast32_t) * m);
+  cost_distinct_t *distinct = malloc(sizeof(cost_distinct_t) * (m + 1));
+  int_fast32_t *rank_of_id = malloc(sizeof(int_fast32_t) * (m + 1));
+  uint64_t *values = malloc(sizeof(uint64_t) * (m + 1));
+  bool ok = table_keys && table_ids && ids && distinct && rank_of_id && values;
+
+  size_t count = 0;
+  if (ok) {
+    for (size_t i = 0; i < capacity; ++i) table_ids[i] = -1;
+
+    // Find the distinct costs, remembering for each bridge which one it uses.
+    for (size_t i = 0; i < m; ++i) {
+      uint64_t key = keys[i];
+      size_t slot = (size_t) ((key * UINT64_C(0x9E3779B97F4A7C15)) >> shift);
+      while (table_ids[slot] != -1 && table_keys[slot] != key) slot = (slot + 1) & (capacity - 1);
+      if (table_ids[slot] == -1) {
+        table_keys[slot] = key;
+        table_ids[slot] = (int_fast32_t) count;
+        distinct[count].key = key;
+        distinct[count].id = (int_fast32_t) count;
+        ++count;
+      }
+      ids[i] = table_ids[slot];
+    }
+
+    // Only the distinct costs have to be sorted.
+    qsort(distinct, count, sizeof(cost_distinct_t), ranks_compare_distinct);
+    for (size_t r = 0; r < count; ++r) {
+      rank_of_id[distinct[r].id] = (int_fast32_t) r;
+      values[r] = distinct[r].key;
+    }
+
+    int bits = 0;
+    while (bits < 31 && ((size_t) 1 << bits) < count) ++bits;
+    ranks->count = count;
+    ranks->mark_red = (uint_fast32_t) 1 << bits;
+    ranks->mask_cost = ranks->mark_red - 1;
+    ranks->levels = (bits + 1 + RADIX_BITS - 1) / RADIX_BITS;
+    ranks->values = values;
+
+    for (size_t i = 0; i < m; ++i) {
+      uint_fast32_t red = (bridges[i].cost & BRIDGE_MARK_RED) ? ranks->mark_red : 0;
+      bridges[i].cost = (uint_fast32_t) rank_of_id[ids[i]] | red;
+    }
+  } else {
+    free(values);
+  }
+
+  free(table_keys);
+  free(table_ids);
+  free(ids);
+  free(distinct);
+  free(rank_of_id);
+  return ok;
 }
 
 /**
  * The result of the algorithm, returning the new happiness totals for blue and red bridges.
  */
 typedef struct result {
-  int red, blue;
+  long long red, blue;
 } result_t;
 
-result_t solve(int n, int m, bridge_t bridges[m]) {
-
-  // Prepare our union-find data structure.
-  uf_item_t uf[n];
+/**
+ * Initializes a union-find array in which each item is its own representative.
+ */
+void uf_init(int n, uf_item_t items[n]) {
   for (int i = 0; i < n; i++) {
-    uf[i].parent = i;
-    uf[i].rank = 0;
+    items[i].parent = i;
+    items[i].rank = 0;
   }
+}
 
-  // Prepare the bridges queue.
-  radix_sort_increasing(m, bridges);
+/**
+ * Runs a slice of Kruskal's algorithm on some bridges sorted by increasing cost, picking the most expensive bridges
+ * first. The selected bridges are moved to the end of the array, in the order in which they were picked.
+ *
+ * @param uf the union-find array, carried across slices.
+ * @param m the number of bridges.
+ * @param bridges the sorted bridges.
+ * @param hi the index after the first bridge of the slice.
+ * @param lo the index of the last bridge of the slice.
+ * @param k the number of bridges selected so far.
+ * @return the number of selected bridges, which are stored in bridges[m - k] to bridges[m - 1].
+ */
+int kruskal_slice(uf_item_t *uf, int m, bridge_t bridges[m], int hi, int lo, int k) {
+  // As we go down, the slot at m - 1 - k has always been read already.
+  for (int i = hi - 1; i >= lo; --i) {
+    if (i - UF_PREFETCH >= lo) {
+      __builtin_prefetch(&uf[bridges[i - UF_PREFETCH].from]);
+      __builtin_prefetch(&uf[bridges[i - UF_PREFETCH].to]);
+    }
+    bridge_t bridge = bridges[i];
+    int fr = uf_find(uf, bridge.from);
+    int tr = uf_find(uf, bridge.to);
+    if (fr != tr) {
+      uf_union_r(uf, fr, tr);
+      bridges[m - 1 - k++] = bridge;
+    }
+  }
+  return k;
+}
 
-  // Iterate over all the bridges, and compute the resulting sum !
+/**
+ * Computes the totals of the k bridges selected by Kruskal's algorithm.
+ */
+result_t totals(int m, int k, const bridge_t bridges[m]) {
   result_t result;
   result.blue = 0;
   result.red = 0;
 
-  for (int i = m - 1; i >= 0; --i) {
+  for (int i = m - k; i < m; ++i) {
     bridge_t bridge = bridges[i];
-    int fr = uf_find(uf, bridge.from);
-    int tr = uf_find(uf, bridge.to);
-    if (fr != tr) {
-      uf_union_r(uf, fr, tr);
-      if ((bridge.cost & BRIDGE_MARK_RED) == BRIDGE_MARK_RED) {
-        result.red += bridge.cost & BRIDGE_MASK_COST;
-      } else {
-        result.blue += bridge.cost;
-      }
+    if ((bridge.cost & BRIDGE_MARK_RED) == BRIDGE_MARK_RED) {
+      result.red += bridge.cost & BRIDGE_MASK_COST;
+    } else {
+      result.blue += bridge.cost;
     }
   }
 
   return result;
 }
 
-#define BUFFER_SIZE (16 * 4096)
+/**
+ * Computes the totals of the k bridges selected by Kruskal's algorithm, using the original costs of the rank table.
+ */
+result_t totals_ranked(int m, int k, const bridge_t bridges[m], const cost_ranks_t *ranks) {
+  result_t result;
+  result.blue = 0;
+  result.red = 0;
+
+  for (int i = m - k; i < m; ++i) {
+    bridge_t bridge = bridges[i];
+    long long cost = ranks_long_of_key(ranks->values[bridge.cost & ranks->mask_cost]);
+    if (bridge.cost & ranks->mark_red) {
+      result.red += cost;
+    } else {
+      result.blue += cost;
+    }
+  }
 
-// A buffer large enough to store any line we're given.
-char input_buffer[BUFFER_SIZE];
-char *input_ptr = input_buffer;
-char *input_ptr_end = input_buffer + BUFFER_SIZE - 1;
+  return result;
+}
 
 /**
- * Initialize the scanner with some proper values.
+ * The result of the algorithm for floating-point costs.
+ */
+typedef struct result_real {
+  double red, blue;
+} result_real_t;
+
+/**
+ * A compensated (Neumaier) sum, which keeps track of the low-order bits lost by each addition.
  */
-void scan_init() {
-  input_buffer[BUFFER_SIZE - 1] = '\0'; // Null-terminate the input buffer.
-  fread(input_buffer, sizeof(char), BUFFER_SIZE - 1, stdin);
-  input_ptr = input_buffer;
+typedef struct sum_real {
+  double sum, compensation;
+} sum_real_t;
+
+static inline void sum_real_add(sum_real_t *s, double x) {
+  double t = s->sum + x;
+  if (fabs(s->sum) >= fabs(x)) {
+    s->compensation += (s->sum - t) + x;
+  } else {
+    s->compensation += (x - t) + s->sum;
+  }
+  s->sum = t;
 }
 
-/** Parses the next multi-digit integer. */
-int scan_int() {
-  int n = 0;
-  while (*input_ptr < '0' || *input_ptr > '9') {
-    ++input_ptr;
-    if (input_ptr == input_ptr_end) {
-      size_t read = fread(input_buffer, sizeof(char), BUFFER_SIZE - 1, stdin);
-      if (read == 0) input_buffer[0] = '\0';
-      input_ptr = input_buffer;
-    }
+/**
+ * Computes the totals of the k bridges selected by Kruskal's algorithm for floating-point costs, with compensated
+ * summation.
+ */
+result_real_t totals_ranked_real(int m, int k, const bridge_t bridges[m], const cost_ranks_t *ranks) {
+  sum_real_t red = {0.0, 0.0};
+  sum_real_t blue = {0.0, 0.0};
+
+  for (int i = m - k; i < m; ++i) {
+    bridge_t bridge = bridges[i];
+    double cost = ranks_double_of_key(ranks->values[bridge.cost & ranks->mask_cost]);
+    sum_real_add((bridge.cost & ranks->mark_red) ? &red : &blue, cost);
   }
-  while (*input_ptr >= '0' && *input_ptr <= '9') {
-    n *= 10;
-    n += *input_ptr - '0';
-    ++input_ptr;
-    if (input_ptr == input_ptr_end) {
-      size_t read = fread(input_buffer, sizeof(char), BUFFER_SIZE - 1, stdin);
-      if (read == 0) input_buffer[0] = '\0';
-      input_ptr = input_buffer;
-    }
+
+  result_real_t result;
+  result.red = red.sum + red.compensation;
+  result.blue = blue.sum + blue.compensation;
+  return result;
+}
+
+/**
+ * The answer for an instance, which is either integer or floating-point depending on its costs.
+ */
+typedef struct answer {
+  bool real;
+  result_t result;
+  result_real_t result_real;
+} answer_t;
+
+/**
+ * Prints an answer on its own line.
+ */
+void answer_print(const answer_t *answer, FILE *file) {
+  if (answer->real) {
+    fprintf(file, "%.15g %.15g\n", answer->result_real.red, answer->result_real.blue);
+  } else {
+    fprintf(file, "%lld %lld\n", answer->result.red, answer->result.blue);
   }
-  return n;
 }
 
-/** Parses the next character in range ['a', 'z']. */
-char scan_char() {
-  char c;
-  while (*input_ptr < 'a' || *input_ptr > 'z') {
-    ++input_ptr;
-    if (input_ptr == input_ptr_end) {
-      size_t read = fread(input_buffer, sizeof(char), BUFFER_SIZE - 1, stdin);
-      if (read == 0) input_buffer[0] = '\0';
-      input_ptr = input_buffer;
-    }
+// STREAMING HASH
+
+/*
+ * XXH64, fed with the bytes of the input as they are read, to recognize inputs which have already been solved. The
+ * bytes are consumed by stripes of 32 bytes; the end of a stripe cut by a refill is kept until the next one.
+ */
+
+#define HASH_PRIME_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME_3 0x165667B19E3779F9ULL
+#define HASH_PRIME_4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME_5 0x27D4EB2F165667C5ULL
+#define HASH_STRIPE 32
+
+/**
+ * The state of a hash being computed.
+ */
+typedef struct hash {
+  uint64_t lanes[4];
+  uint64_t seed;
+  uint64_t total;                        // The number of bytes hashed so far.
+  size_t buffered;                       // The number of bytes waiting in stripe.
+  unsigned char stripe[HASH_STRIPE];
+} hash_t;
+
+static inline uint64_t hash_rotate(uint64_t x, int bits) {
+  return (x << bits) | (x >> (64 - bits));
+}
+
+static inline uint64_t hash_read_u64(const unsigned char *p) {
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static inline uint64_t hash_round(uint64_t lane, uint64_t input) {
+  return hash_rotate(lane + input * HASH_PRIME_2, 31) * HASH_PRIME_1;
+}
+
+static inline uint64_t hash_merge(uint64_t h, uint64_t lane) {
+  return (h ^ hash_round(0, lane)) * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+void hash_init(hash_t *hash, uint64_t seed) {
+  hash->lanes[0] = seed + HASH_PRIME_1 + HASH_PRIME_2;
+  hash->lanes[1] = seed + HASH_PRIME_2;
+  hash->lanes[2] = seed;
+  hash->lanes[3] = seed - HASH_PRIME_1;
+  hash->seed = seed;
+  hash->total = 0;
+  hash->buffered = 0;
+}
+
+static inline void hash_stripe(hash_t *hash, const unsigned char *p) {
+  for (int l = 0; l < 4; ++l) hash->lanes[l] = hash_round(hash->lanes[l], hash_read_u64(p + 8 * l));
+}
+
+/**
+ * Adds some bytes to a hash.
+ */
+void hash_update(hash_t *hash, const void *data, size_t length) {
+  const unsigned char *p = data;
+  hash->total += length;
+  if (hash->buffered > 0) {
+    size_t taken = HASH_STRIPE - hash->buffered < length ? HASH_STRIPE - hash->buffered : length;
+    memcpy(hash->stripe + hash->buffered, p, taken);
+    hash->buffered += taken;
+    p += taken;
+    length -= taken;
+    if (hash->buffered < HASH_STRIPE) return;
+    hash_stripe(hash, hash->stripe);
+    hash->buffered = 0;
+  }
+  for (; length >= HASH_STRIPE; p += HASH_STRIPE, length -= HASH_STRIPE) hash_stripe(hash, p);
+  memcpy(hash->stripe, p, length);
+  hash->buffered = length;
+}
+
+/**
+ * Computes the hash of the bytes added so far.
+ */
+uint64_t hash_digest(const hash_t *hash) {
+  uint64_t h;
+  if (hash->total >= HASH_STRIPE) {
+    h = hash_rotate(hash->lanes[0], 1) + hash_rotate(hash->lanes[1], 7) + hash_rotate(hash->lanes[2], 12) +
+        hash_rotate(hash->lanes[3], 18);
+    for (int l = 0; l < 4; ++l) h = hash_merge(h, hash->lanes[l]);
+  } else {
+    h = hash->seed + HASH_PRIME_5;
+  }
+  h += hash->total;
+
+  const unsigned char *p = hash->stripe;
+  size_t length = hash->buffered;
+  for (; length >= 8; p += 8, length -= 8) {
+    h = hash_rotate(h ^ hash_round(0, hash_read_u64(p)), 27) * HASH_PRIME_1 + HASH_PRIME_4;
   }
-  c = *input_ptr;
-  ++input_ptr;
-  if (input_ptr == input_ptr_end) {
-    size_t read = fread(input_buffer, sizeof(char), BUFFER_SIZE - 1, stdin);
-    if (read == 0) input_buffer[0] = '\0';
-    input_ptr = input_buffer;
+  if (length >= 4) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    h = hash_rotate(h ^ (word * HASH_PRIME_1), 23) * HASH_PRIME_2 + HASH_PRIME_3;
+    p += 4;
+    length -= 4;
   }
-  return c;
+  for (; length > 0; ++p, --length) h = hash_rotate(h ^ (*p * HASH_PRIME_5), 11) * HASH_PRIME_1;
+
+  h ^= h >> 33;
+  h *= HASH_PRIME_2;
+  h ^= h >> 29;
+  h *= HASH_PRIME_3;
+  h ^= h >> 32;
+  return h;
 }
 
-int main() {
+#define BUFFER_SIZE (16 * 4096)
+
+// SCANNER
 
-  scan_init();
+/*
+ * The scanner only refills its buffer at line boundaries: before each line, scan_reserve makes sure at least
+ * SCAN_LINE_MAX bytes are available (unless the input ends first). The bytes read are always followed by a '\0'
+ * sentinel, so the parsing loops only have to look at characters and never compare against the end of the buffer.
+ * A token which still gets cut by the end of the buffer (on a line longer than SCAN_LINE_MAX) is carried over to the
+ * next refill on a slow path.
+ *
+ * The buffer is sized from the input: a regular file gets a buffer large enough to be read with a single syscall (up
+ * to SCAN_BUFFER_MAX), while pipes get BUFFER_SIZE. The size can be forced with scan_buffer_size.
+ */
+#define SCAN_LINE_MAX 256
+#define SCAN_NUMBER_MAX 64
+#define SCAN_PADDING 8      // Bytes after the sentinel, so 8 bytes can always be loaded at once.
+#define SCAN_BUFFER_MIN (4 * SCAN_LINE_MAX)
+#define SCAN_BUFFER_MAX (64 * 1024 * 1024)
 
-  int n = scan_int();
-  int m = scan_int();
+// The size of the scanner buffers, or 0 to size them from the input.
+size_t scan_buffer_size = 0;
 
-  bridge_t bridges[m];
+// Whether the scanners hash the bytes they read, for the result cache.
+bool scan_hashing = false;
 
-  for (int i = 0; i < m; i++) {
-    int_fast32_t from = (int_fast32_t) scan_int();
-    int_fast32_t to = (int_fast32_t) scan_int();
-    int_fast16_t cost = (int_fast16_t) scan_int();
-    char company = scan_char();
+/**
+ * The state of a scanner, with a buffer large enough to store any line we're given. Each instance being solved has
+ * its own scanner, so parsing can be interleaved or resumed.
+ */
+typedef struct scanner {
+  FILE *file;
+  int fd;             // The file descriptor we read from directly, or -1 to go through the FILE.
+  char *ptr;
+  char *limit;        // The end of the bytes read, where the sentinel is stored.
+  bool eof;
+  size_t capacity;
+  size_t reads;       // The number of read calls issued so far.
+  size_t bytes;       // The number of bytes read so far.
+  bool hashing;
+  hash_t hash;        // The hash of the bytes read so far, when hashing.
+  char *buffer;
+} scanner_t;
 
-    bridges[i].from = from - 1;
-    bridges[i].to = to - 1;
-    bridges[i].cost = cost;
-    if (company == 'r') bridges[i].cost |= BRIDGE_MARK_RED;
+/**
+ * Moves the bytes after keep to the start of the buffer, and fills the rest of the buffer from the input.
+ *
+ * @return false if no more bytes could be read.
+ */
+static bool scan_refill(scanner_t *s, char *keep) {
+  if (s->eof) return false;
+  size_t kept = s->limit - keep;
+  memmove(s->buffer, keep, kept);
+  size_t wanted = s->capacity - kept;
+  size_t got = 0;
+  if (s->fd >= 0) {
+    while (got < wanted) {
+      ssize_t r = read(s->fd, s->buffer + kept + got, wanted - got);
+      s->reads++;
+      if (r <= 0) {
+        s->eof = true;
+        break;
+      }
+      got += (size_t) r;
+    }
+  } else {
+    got = fread(s->buffer + kept, sizeof(char), wanted, s->file);
+    s->reads++;
+    s->eof = got < wanted;
   }
+  s->bytes += got;
+  if (s->hashing) hash_update(&s->hash, s->buffer + kept, got);
+  s->ptr = s->buffer;
+  s->limit = s->buffer + kept + got;
+  *s->limit = '\0';
+  return got > 0;
+}
 
-  result_t result = solve(n, m, bridges);
-  printf("%d %d\n", result.red, result.blue);
-  return 0;
+/**
+ * Picks the size of the buffer for the given input, and hints the kernel that it will be read sequentially.
+ */
+static size_t scan_size_for(int fd) {
+  size_t size = scan_buffer_size;
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    // One more byte than the file, so the first read already sees the end of the input.
+    if (size == 0) size = st.st_size < SCAN_BUFFER_MAX ? (size_t) st.st_size + 1 : SCAN_BUFFER_MAX;
+  }
+  if (size == 0) size = BUFFER_SIZE;
+  return size < SCAN_BUFFER_MIN ? SCAN_BUFFER_MIN : size;
+}
+
+/**
+ * Initialize the scanner with some proper values.
+ *
+ * @return false if the buffer could not be allocated.
+ */
+bool scan_init(scanner_t *s, FILE *file) {
+  s->file = file;
+  s->fd = fileno(file);
+  s->eof = false;
+  s->reads = 0;
+  s->bytes = 0;
+  s->hashing = scan_hashing;
+  if (s->hashing) hash_init(&s->hash, 0);
+  s->capacity = scan_size_for(s->fd);
+  s->buffer = malloc(s->capacity + SCAN_PADDING);
+  if (s->buffer == NULL) return false;
+  s->ptr = s->limit = s->buffer;
+  memset(s->buffer + s->capacity, 0, SCAN_PADDING);
+  scan_refill(s, s->ptr);
+  return true;
+}
+
+/**
+ * Reads the rest of the input, so that all of it has been hashed.
+ */
+void scan_drain(scanner_t *s) {
+  while (scan_refill(s, s->limit));
+}
+
+void scan_free(scanner_t *s) {
+  free(s->buffer);
+  s->buffer = NULL;
+}
+
+/**
+ * Prints the statistics of a scanner.
+ */
+void scan_print_stats(const scanner_t *s, FILE *file) {
+  fprintf(file, "scanner: %zu bytes in %zu reads, %zu bytes buffer\n", s->bytes, s->reads, s->capacity);
+}
+
+/** Makes sure a whole line can be parsed from the buffer without refilling it. */
+static inline void scan_reserve(scanner_t *s) {
+  if (unlikely(s->limit - s->ptr < SCAN_LINE_MAX)) scan_refill(s, s->ptr);
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SCAN_SWAR 1
+
+/**
+ * Parses up to 8 digits at once, SIMD-within-a-register style. The 8 bytes at p are loaded in a single word, the
+ * number of leading digits is found from a mask of the non-digit bytes, and the digits are combined pairwise with
+ * three multiplications.
+ *
+ * @param p the start of the digits, with at least 8 readable bytes.
+ * @param n where the value of the digits is stored.
+ * @return the number of digits which were parsed, between 0 and 8.
+ */
+static inline int scan_swar8(const char *p, uint_fast32_t *n) {
+  uint64_t chunk;
+  memcpy(&chunk, p, sizeof(chunk));
+  uint64_t x = chunk ^ UINT64_C(0x3030303030303030);
+
+  // A byte is a digit iff it became 0 to 9. Carries only leak past the first non-digit, which is all we look at.
+  uint64_t non_digits = (x & UINT64_C(0xF0F0F0F0F0F0F0F0)) | ((x + UINT64_C(0x0606060606060606)) & UINT64_C(0x1010101010101010));
+  int digits = non_digits == 0 ? 8 : __builtin_ctzll(non_digits) / 8;
+  if (digits == 0) {
+    *n = 0;
+    return 0;
+  }
+
+  // Right-align the digits, which pads the number with leading zeros, then combine them.
+  x <<= 8 * (8 - digits);
+  x = (x * 10) + (x >> 8);
+  x = (((x & UINT64_C(0x000000FF000000FF)) * (100 + (UINT64_C(1000000) << 32))) +
+       (((x >> 16) & UINT64_C(0x000000FF000000FF)) * (1 + (UINT64_C(10000) << 32)))) >> 32;
+  *n = (uint_fast32_t) x;
+  return digits;
+}
+#endif
+
+/** Parses the next multi-digit integer. */
+int scan_int(scanner_t *s) {
+  const char *p = s->ptr;
+  for (;;) {
+    while (*p != '\0' && (*p < '0' || *p > '9')) ++p;
+    const char *start = p;
+    int n = 0;
+#ifdef SCAN_SWAR
+    uint_fast32_t head;
+    int digits = scan_swar8(p, &head);
+    n = (int) head;
+    p += digits;
+    if (likely(digits < 8)) goto done;
+#endif
+    while (*p >= '0' && *p <= '9') {
+      n *= 10;
+      n += *p - '0';
+      ++p;
+    }
+#ifdef SCAN_SWAR
+  done:
+#endif
+    // The sentinel is only reached on a line longer than SCAN_LINE_MAX, or at the end of the input.
+    if (likely(*p != '\0') || s->eof) {
+      s->ptr = (char *) p;
+      return n;
+    }
+    if (!scan_refill(s, (char *) start)) {
+      s->ptr = s->limit;
+      return n;
+    }
+    p = s->ptr;
+  }
+}
+
+/** Parses the next unsigned 64-bit integer, wrapping around on overflow. */
+uint64_t scan_u64(scanner_t *s) {
+  const char *p = s->ptr;
+  for (;;) {
+    while (*p != '\0' && (*p < '0' || *p > '9')) ++p;
+    const char *start = p;
+    uint64_t n = 0;
+    while (*p >= '0' && *p <= '9') {
+      n = n * 10 + (uint64_t) (*p - '0');
+      ++p;
+    }
+    if (likely(*p != '\0') || s->eof) {
+      s->ptr = (char *) p;
+      return n;
+    }
+    if (!scan_refill(s, (char *) start)) {
+      s->ptr = s->limit;
+      return n;
+    }
+    p = s->ptr;
+  }
+}
+
+// The powers of ten which are exact doubles, for the fast path of the floating-point costs.
+static const double scan_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/**
+ * Parses the next cost, which may be negative, exceed the range of an int, or be a floating-point number.
+ *
+ * A plain decimal number whose digits fit in the 53 bits of a double and whose fraction has at most 22 digits is
+ * divided by its exact power of ten, which rounds correctly, like strtod. Exponents and longer numbers are left to
+ * strtod.
+ *
+ * @param s the scanner.
+ * @param integer where the cost is stored if it is an integer.
+ * @param real where the cost is stored if it is a floating-point number.
+ * @return true if the cost was a floating-point number.
+ */
+bool scan_cost(scanner_t *s, long long *integer, double *real) {
+  const char *p = s->ptr;
+  for (;;) {
+    bool negative = false;
+    while (*p != '\0' && (*p < '0' || *p > '9') && *p != '.') {
+      negative = *p == '-';
+      ++p;
+    }
+    const char *start = p;
+    unsigned long long n = 0;
+    bool floating = false;
+    bool plain = true;    // Whether the number only has digits and a point.
+    int digits = 0;
+    int fraction = -1;    // The number of digits after the point, or -1 before it.
+    while ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' ||
+           (floating && (*p == '-' || *p == '+'))) {
+      if (*p >= '0' && *p <= '9') {
+        n *= 10;
+        n += (unsigned) (*p - '0');
+        ++digits;
+        fraction += fraction >= 0;
+      } else if (*p == '.' && fraction < 0) {
+        floating = true;
+        fraction = 0;
+      } else {
+        floating = true;
+        plain = false;
+      }
+      ++p;
+    }
+    if (unlikely(*p == '\0') && !s->eof) {
+      // Carry the sign over as well.
+      if (!scan_refill(s, (char *) (negative ? start - 1 : start))) break;
+      p = s->ptr;
+      continue;
+    }
+    s->ptr = (char *) p;
+    if (floating && plain && digits <= 19 && n <= UINT64_C(1) << 53 && fraction <= 22) {
+      double value = (double) n / scan_powers_of_ten[fraction];
+      *real = negative ? -value : value;
+    } else if (unlikely(floating)) {
+      char token[SCAN_NUMBER_MAX];
+      size_t length = p - start < SCAN_NUMBER_MAX - 2 ? p - start : SCAN_NUMBER_MAX - 2;
+      token[0] = '-';
+      memcpy(token + 1, start, length);
+      token[length + 1] = '\0';
+      *real = strtod(negative ? token : token + 1, NULL);
+    } else {
+      *integer = (long long) (negative ? 0 - n : n);
+    }
+    return floating;
+  }
+  s->ptr = s->limit;
+  *integer = 0;
+  return false;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SCAN_WORD(a, b, c, d) (((uint32_t) (a) << 24) | ((uint32_t) (b) << 16) | ((uint32_t) (c) << 8) | (uint32_t) (d))
+#else
+#define SCAN_WORD(a, b, c, d) ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16) | ((uint32_t) (d) << 24))
+#endif
+
+/**
+ * Parses the next company token, along with the newline that follows it. The usual "red" and "blue" tokens are
+ * recognized with a single 4-byte compare, while any other word falls back to a loop over its letters. Only the first
+ * letter matters, as in the original format.
+ *
+ * @return BRIDGE_MARK_RED for a red company, 0 otherwise.
+ */
+uint_fast32_t scan_company(scanner_t *s) {
+  const char *p = s->ptr;
+  for (;;) {
+    while (*p != '\0' && (*p < 'a' || *p > 'z')) ++p;
+    const char *start = p;
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    uint_fast32_t red = *p == 'r';
+    if (likely((word & SCAN_WORD(0xFF, 0xFF, 0xFF, 0)) == SCAN_WORD('r', 'e', 'd', 0) ||
+               word == SCAN_WORD('b', 'l', 'u', 'e'))) {
+      p += 4 - red;
+    } else {
+      while (*p >= 'a' && *p <= 'z') ++p;
+      if (unlikely(*p == '\0') && !s->eof) {
+        if (!scan_refill(s, (char *) start)) break;
+        p = s->ptr;
+        continue;
+      }
+    }
+    p += *p == '\n';
+    s->ptr = (char *) p;
+    return red * (BRIDGE_MARK_RED);
+  }
+  s->ptr = s->limit;
+  return 0;
+}
+
+/**
+ * Finds the next whitespace-separated token, without copying it. The token is only valid until the scanner goes on.
+ *
+ * @param length where the length of the token is stored, 0 at the end of the input.
+ * @return the start of the token.
+ */
+const char *scan_token(scanner_t *s, size_t *length) {
+  const char *p = s->ptr;
+  for (;;) {
+    while (*p != '\0' && (unsigned char) *p <= ' ') ++p;
+    const char *start = p;
+    while ((unsigned char) *p > ' ') ++p;
+    if (unlikely(*p == '\0') && !s->eof) {
+      if (!scan_refill(s, (char *) start)) break;
+      p = s->ptr;
+      continue;
+    }
+    s->ptr = (char *) p;
+    *length = (size_t) (p - start);
+    return start;
+  }
+  s->ptr = s->limit;
+  *length = 0;
+  return s->ptr;
+}
+
+/**
+ * Parses the next whitespace-separated word.
+ *
+ * @param word where the word is stored, null-terminated.
+ * @param size the size of word, beyond which the word is truncated.
+ * @return the length of the word, 0 at the end of the input.
+ */
+size_t scan_word(scanner_t *s, char *word, size_t size) {
+  size_t length;
+  const char *token = scan_token(s, &length);
+  if (length > size - 1) length = size - 1;
+  memcpy(word, token, length);
+  word[length] = '\0';
+  return length;
+}
+
+/**
+ * Checks whether the input continues with the given keyword, without consuming anything.
+ */
+bool scan_peek(scanner_t *s, const char *keyword) {
+  scan_reserve(s);
+  const char *p = s->ptr;
+  while (*p != '\0' && (unsigned char) *p <= ' ') ++p;
+  size_t length = strlen(keyword);
+  return strncmp(p, keyword, length) == 0 && (unsigned char) p[length] <= ' ';
+}
+
+// ARENAS
+
+/**
+ * A block of memory from which an arena hands out allocations.
+ */
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t size, used;
+  max_align_t data[];
+} arena_block_t;
+
+/**
+ * A bump allocator. Everything allocated from an arena is released at once when it is reset, and the largest block is
+ * kept for the next use, so a worker solving many instances in a row stops allocating once it has warmed up.
+ */
+typedef struct arena {
+  arena_block_t *head;
+} arena_t;
+
+#define ARENA_BLOCK_MIN (1024 * 1024)
+
+void arena_init(arena_t *arena) {
+  arena->head = NULL;
+}
+
+/**
+ * Allocates some memory from an arena, aligned for any type.
+ *
+ * @return the allocated memory, or NULL if we ran out of memory.
+ */
+void *arena_alloc(arena_t *arena, size_t size) {
+  size = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+  arena_block_t *head = arena->head;
+  if (head == NULL || head->size - head->used < size) {
+    size_t block = head == NULL ? ARENA_BLOCK_MIN : 2 * head->size;
+    if (block < size) block = size;
+    arena_block_t *fresh = malloc(sizeof(arena_block_t) + block);
+    if (fresh == NULL) return NULL;
+    fresh->next = head;
+    fresh->size = block;
+    fresh->used = 0;
+    arena->head = head = fresh;
+  }
+  void *memory = (char *) head->data + head->used;
+  head->used += size;
+  return memory;
+}
+
+/**
+ * Releases everything allocated from an arena, keeping its largest block.
+ */
+void arena_reset(arena_t *arena) {
+  arena_block_t *head = arena->head;
+  if (head == NULL) return;
+  for (arena_block_t *block = head->next, *next; block != NULL; block = next) {
+    next = block->next;
+    free(block);
+  }
+  head->next = NULL;
+  head->used = 0;
+}
+
+void arena_free(arena_t *arena) {
+  arena_reset(arena);
+  free(arena->head);
+  arena->head = NULL;
+}
+
+// THREAD POOL
+
+/**
+ * A pool of worker threads running parallel loops. The thread calling pool_run takes part in the loop as well, so a
+ * pool of a single thread has no worker at all. Loops can't be nested: a job must not call pool_run itself.
+ */
+typedef struct pool {
+  int threads;
+  pthread_t *workers;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  unsigned generation;   // Incremented for each loop, so the workers know there's a new job.
+  int active;            // The number of workers which haven't finished the current loop yet.
+  bool stop;
+
+  // The current loop.
+  void (*job)(void *context, size_t i);
+  void *context;
+  size_t count;
+  atomic_size_t next;
+} pool_t;
+
+/**
+ * Runs the iterations of the current loop which haven't been claimed yet.
+ */
+static void pool_work(pool_t *pool) {
+  for (;;) {
+    size_t i = atomic_fetch_add_explicit(&pool->next, 1, memory_order_relaxed);
+    if (i >= pool->count) return;
+    pool->job(pool->context, i);
+  }
+}
+
+static void *pool_worker(void *argument) {
+  pool_t *pool = argument;
+  unsigned seen = 0;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->stop && pool->generation == seen) pthread_cond_wait(&pool->wake, &pool->lock);
+    if (pool->stop) break;
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+    pool_work(pool);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->active == 0) pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**
+ * Starts a pool with the given number of threads, including the calling one.
+ *
+ * @return false if the threads could not be started.
+ */
+bool pool_init(pool_t *pool, int threads) {
+  pool->threads = threads < 1 ? 1 : threads;
+  pool->generation = 0;
+  pool->active = 0;
+  pool->stop = false;
+  pool->count = 0;
+  atomic_init(&pool->next, 0);
+  pool->workers = malloc(sizeof(pthread_t) * pool->threads);
+  if (pool->workers == NULL) return false;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  for (int t = 1; t < pool->threads; ++t) {
+    if (pthread_create(&pool->workers[t], NULL, pool_worker, pool) != 0) {
+      pool->threads = t;
+      break;
+    }
+  }
+  return true;
+}
+
+/**
+ * Runs job(context, i) for each i in [0, count), spread over the threads of the pool, and waits for all of them.
+ */
+void pool_run(pool_t *pool, size_t count, void (*job)(void *context, size_t i), void *context) {
+  pthread_mutex_lock(&pool->lock);
+  pool->job = job;
+  pool->context = context;
+  pool->count = count;
+  atomic_store(&pool->next, 0);
+  pool->active = pool->threads - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  pool_work(pool);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->active > 0) pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_free(pool_t *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  for (int t = 1; t < pool->threads; ++t) pthread_join(pool->workers[t], NULL);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->done);
+  free(pool->workers);
+}
+
+/**
+ * Runs job(context, chunk) for each chunk of count items split in chunks of the given size, on the pool if there is one
+ * and more than one chunk, or on the calling thread otherwise.
+ */
+void pool_run_chunks(pool_t *pool, size_t count, size_t size, void (*job)(void *context, size_t chunk), void *context) {
+  size_t chunks = (count + size - 1) / size;
+  if (pool != NULL && chunks > 1) {
+    pool_run(pool, chunks, job, context);
+  } else {
+    for (size_t chunk = 0; chunk < chunks; ++chunk) job(context, chunk);
+  }
+}
+
+#define PREFIX_CHUNK (16 * 1024)   // The smallest number of counts summed by each job of a parallel prefix sum.
+#define PREFIX_CHUNKS_MAX 256      // The largest number of jobs of a parallel prefix sum.
+
+/**
+ * The state of a parallel prefix sum: the counts are split in chunks, which are summed, then scanned from the sum of
+ * the chunks before them.
+ */
+typedef struct prefix_sum_job {
+  int *values;
+  size_t count;
+  size_t size;                   // The number of counts in each chunk.
+  int sums[PREFIX_CHUNKS_MAX];   // The sum of each chunk, then the sum of the chunks before it.
+} prefix_sum_job_t;
+
+static void prefix_sum_reduce_job(void *context, size_t chunk) {
+  prefix_sum_job_t *job = context;
+  size_t begin = chunk * job->size;
+  size_t end = begin + job->size < job->count ? begin + job->size : job->count;
+  int sum = 0;
+  for (size_t i = begin; i < end; ++i) sum += job->values[i];
+  job->sums[chunk] = sum;
+}
+
+static void prefix_sum_scan_job(void *context, size_t chunk) {
+  prefix_sum_job_t *job = context;
+  size_t begin = chunk * job->size;
+  size_t end = begin + job->size < job->count ? begin + job->size : job->count;
+  int sum = job->sums[chunk];
+  for (size_t i = begin; i < end; ++i) {
+    int value = job->values[i];
+    job->values[i] = sum;
+    sum += value;
+  }
+}
+
+/**
+ * Computes the exclusive prefix sums of some counts like prefix_sum, on the pool if there is one and enough counts to
+ * make it worth it.
+ *
+ * @return the sum of all the counts.
+ */
+int pool_prefix_sum(pool_t *pool, size_t count, int values[]) {
+  if (pool == NULL || count < 2 * PREFIX_CHUNK) return prefix_sum(count, values);
+  prefix_sum_job_t job;
+  job.values = values;
+  job.count = count;
+  job.size = (count + PREFIX_CHUNKS_MAX - 1) / PREFIX_CHUNKS_MAX;
+  if (job.size < PREFIX_CHUNK) job.size = PREFIX_CHUNK;
+  size_t chunks = (count + job.size - 1) / job.size;
+  pool_run_chunks(pool, count, job.size, prefix_sum_reduce_job, &job);
+  int sum = prefix_sum(chunks, job.sums);
+  pool_run_chunks(pool, count, job.size, prefix_sum_scan_job, &job);
+  return sum;
+}
+
+/**
+ * The number of threads to use by default, one per online processor.
+ */
+int pool_default_threads(void) {
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  return online < 1 ? 1 : (int) online;
+}
+
+// BORŮVKA WITH CONTRACTION
+
+/*
+ * Borůvka's algorithm picks the most expensive bridge leaving each component, all at once, and merges the components
+ * along them. Ties are broken by the position of the bridge, the earlier one first, so the picked bridges never form a
+ * cycle. The rounds keep the bridges in the order of the input, so this is the tie order of bridge_t.
+ *
+ * After each round, the islands are relabeled to dense component ids, the bridges inside a component are dropped and
+ * only the most expensive bridge between each pair of components is kept. The bridges left shrink geometrically on
+ * dense networks, so later rounds cost much less than the first one. Picking and compaction run on a pool, one chunk
+ * of bridges per job; the per-component steps are linear in the number of components and stay on the calling thread.
+ */
+
+#define BORUVKA_CHUNK (64 * 1024)   // The number of bridges in each job of a parallel loop.
+
+// The pool for the loops inside an instance, or NULL to run them on the calling thread.
+pool_t *solver_pool = NULL;
+
+/**
+ * The state of a Borůvka round, shared by the jobs of its parallel loops.
+ */
+typedef struct boruvka {
+  bridge_t *bridges;            // The bridges of the round, between component ids.
+  bridge_t *compacted;          // The bridges left for the next round.
+  int m;
+  _Atomic uint64_t *best;       // For each component, the key of its best bridge: cost, then m - position. 0 if none.
+  const int *label;             // The component id of the next round, for each component id of this round.
+  int *counts;                  // The number of bridges each chunk keeps, then the index of its first kept bridge.
+} boruvka_t;
+
+static inline int boruvka_chunks(int m) {
+  return (m + BORUVKA_CHUNK - 1) / BORUVKA_CHUNK;
+}
+
+static inline void boruvka_offer(_Atomic uint64_t *slot, uint64_t key) {
+  uint64_t seen = atomic_load_explicit(slot, memory_order_relaxed);
+  while (seen < key &&
+         !atomic_compare_exchange_weak_explicit(slot, &seen, key, memory_order_relaxed, memory_order_relaxed));
+}
+
+static void boruvka_pick_job(void *context, size_t chunk) {
+  boruvka_t *round = context;
+  int end = (int) chunk * BORUVKA_CHUNK + BORUVKA_CHUNK < round->m ? (int) chunk * BORUVKA_CHUNK + BORUVKA_CHUNK
+                                                                    : round->m;
+  for (int i = (int) chunk * BORUVKA_CHUNK; i < end; ++i) {
+    bridge_t bridge = round->bridges[i];
+    if (unlikely(bridge.from == bridge.to)) continue;
+    uint64_t key = ((uint64_t) bridge.cost << 32) | (uint32_t) (round->m - i);
+    boruvka_offer(&round->best[bridge.from], key);
+    boruvka_offer(&round->best[bridge.to], key);
+  }
+}
+
+/**
+ * Moves the bridges of a chunk to their component ids for the next round, and counts those which aren't inside a
+ * component. When the counts are already turned into indices, also stores the kept bridges.
+ */
+static void boruvka_compact(boruvka_t *round, size_t chunk, bool store) {
+  int begin = (int) chunk * BORUVKA_CHUNK;
+  int end = begin + BORUVKA_CHUNK < round->m ? begin + BORUVKA_CHUNK : round->m;
+  int kept = store ? round->counts[chunk] : 0;
+  for (int i = begin; i < end; ++i) {
+    bridge_t bridge = round->bridges[i];
+    int from = round->label[bridge.from];
+    int to = round->label[bridge.to];
+    if (from == to) continue;
+    if (store) {
+      bridge.from = from < to ? from : to;
+      bridge.to = from < to ? to : from;
+      round->compacted[kept] = bridge;
+    }
+    kept++;
+  }
+  if (!store) round->counts[chunk] = kept;
+}
+
+static void boruvka_count_job(void *context, size_t chunk) {
+  boruvka_compact(context, chunk, false);
+}
+
+static void boruvka_store_job(void *context, size_t chunk) {
+  boruvka_compact(context, chunk, true);
+}
+
+/**
+ * Keeps only the most expensive bridge between each pair of components, in place.
+ *
+ * @param table a hash table of at least 2 * m slots.
+ * @return the number of bridges kept.
+ */
+static int boruvka_dedup(int m, bridge_t bridges[m], int table[]) {
+  size_t capacity = 4;
+  while (capacity < 2 * (size_t) m) capacity <<= 1;
+  memset(table, -1, sizeof(int) * capacity);
+
+  for (int i = 0; i < m; ++i) {
+    bridge_t bridge = bridges[i];
+    uint64_t pair = ((uint64_t) bridge.from << 32) | (uint32_t) bridge.to;
+    size_t slot = (size_t) ((pair * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+    while (table[slot] >= 0 && (bridges[table[slot]].from != bridge.from || bridges[table[slot]].to != bridge.to)) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    if (table[slot] < 0 || bridges[table[slot]].cost < bridge.cost) table[slot] = i;
+  }
+
+  // The winners are marked by complementing their first island, and moved down in place.
+  for (size_t slot = 0; slot < capacity; ++slot) {
+    if (table[slot] >= 0) bridges[table[slot]].from = ~bridges[table[slot]].from;
+  }
+  int kept = 0;
+  for (int i = 0; i < m; ++i) {
+    bridge_t bridge = bridges[i];
+    if (bridge.from < 0) {
+      bridge.from = ~bridge.from;
+      bridges[kept++] = bridge;
+    }
+  }
+  return kept;
+}
+
+/**
+ * Runs Borůvka's algorithm with contraction on some bridges, in any order.
+ *
+ * @param pool the pool for the parallel loops, or NULL.
+ * @param n the number of islands.
+ * @param m the number of bridges.
+ * @param bridges the bridges, which get overwritten.
+ * @param buffer a buffer of m bridges.
+ * @return the number of selected bridges, which are stored in bridges[m - k] to bridges[m - 1], or -1 if we ran out
+ *         of memory.
+ */
+int boruvka(pool_t *pool, int n, int m, bridge_t bridges[m], bridge_t buffer[m]) {
+  boruvka_t round;
+  round.best = malloc(sizeof(*round.best) * (n + 1));
+  int *label = malloc(sizeof(int) * (n + 1));
+  uf_item_t *uf = uf_alloc(n + 1);
+  bridge_t *selected = malloc(sizeof(bridge_t) * (n + 1));
+  int *table = malloc(sizeof(int) * (4 * (size_t) m + 4));
+  round.counts = malloc(sizeof(int) * (boruvka_chunks(m) + 1));
+  int k = -1;
+  if (round.best != NULL && label != NULL && uf != NULL && selected != NULL && table != NULL && round.counts != NULL) {
+    k = 0;
+    round.bridges = bridges;
+    round.compacted = buffer;
+    round.m = m;
+    round.label = label;
+    for (int c = n; round.m > 0;) {
+      // Each component picks its most expensive bridge.
+      for (int u = 0; u < c; ++u) atomic_init(&round.best[u], 0);
+      pool_run_chunks(pool, (size_t) round.m, BORUVKA_CHUNK, boruvka_pick_job, &round);
+      uf_init(c, uf);
+      for (int u = 0; u < c; ++u) {
+        uint64_t key = atomic_load_explicit(&round.best[u], memory_order_relaxed);
+        if (key == 0) continue;
+        bridge_t bridge = round.bridges[round.m - (int) (uint32_t) key];
+        int fr = uf_find(uf, bridge.from);
+        int tr = uf_find(uf, bridge.to);
+        if (fr != tr) {
+          uf_union_r(uf, fr, tr);
+          selected[k++] = bridge;
+        }
+      }
+
+      // Relabels the merged components densely. Only the labels of representatives are read, so this works in place.
+      int components = 0;
+      for (int u = 0; u < c; ++u) label[u] = -1;
+      for (int u = 0; u < c; ++u) {
+        int r = uf_find(uf, u);
+        if (label[r] < 0) label[r] = components++;
+        label[u] = label[r];
+      }
+
+      // Moves the bridges between components to the other array, then drops the parallel ones.
+      int chunks = boruvka_chunks(round.m);
+      pool_run_chunks(pool, (size_t) round.m, BORUVKA_CHUNK, boruvka_count_job, &round);
+      int kept = pool_prefix_sum(pool, (size_t) chunks, round.counts);
+      pool_run_chunks(pool, (size_t) round.m, BORUVKA_CHUNK, boruvka_store_job, &round);
+      bridge_t *next = round.compacted;
+      round.compacted = round.bridges;
+      round.bridges = next;
+      round.m = boruvka_dedup(kept, next, table);
+      c = components;
+    }
+
+    memcpy(bridges + m - k, selected, sizeof(bridge_t) * k);
+  }
+  free(round.best);
+  free(label);
+  uf_free(uf);
+  free(selected);
+  free(table);
+  free(round.counts);
+  return k;
+}
+
+// FOREST VERIFICATION
+
+/*
+ * A bridge whose cost is lower than the cost of every bridge on the path between its islands in some forest can't be
+ * in a maximum spanning forest: by the cycle property, it would be the cheapest bridge of that cycle. Such bridges are
+ * found with Tarjan's offline algorithm: a depth-first walk of the forest links each finished island to its parent in
+ * a union-find which also keeps the cheapest cost up to the linked ancestor, and a query is answered when the lowest
+ * common ancestor of its islands finishes, at which point both islands are linked below it.
+ */
+
+#define FOREST_COST_MAX UINT_FAST32_MAX   // The cost of an empty path.
+
+/**
+ * The state of a verification: the forest as adjacency lists, the queries of each island and the union-find.
+ */
+typedef struct forest_walk {
+  int *offsets, *neighbors;       // The bridges of each island in the forest.
+  uint_fast32_t *costs;
+  int *query_offsets, *queries;   // The queries of each island.
+  int *link;                      // The union-find parent of each island, linked to its parent once finished.
+  uint_fast32_t *cheapest;        // The cheapest cost between an island and its union-find parent.
+  int *parent;                    // The parent of each island in the walk, -1 for roots.
+  uint_fast32_t *up;              // The cost of the bridge to the parent.
+  int *tree;                      // The root of the tree of each island, -1 until visited.
+  bool *finished;
+  int *bucket, *next;             // The queries to answer once each island finishes, chained through next.
+  int *stack, *cursor;            // The islands being visited, and the position of their next neighbor.
+  int *path;
+} forest_walk_t;
+
+/**
+ * Finds the cheapest cost on the path from an island to its linked ancestor which hasn't finished yet, compressing
+ * the path on the way.
+ */
+static uint_fast32_t forest_cheapest(forest_walk_t *walk, int u) {
+  int length = 0;
+  while (walk->link[u] != u) {
+    walk->path[length++] = u;
+    u = walk->link[u];
+  }
+  int root = u;
+  // From the island closest to the root down, so each parent already points to the root.
+  for (int i = length - 2; i >= 0; --i) {
+    int x = walk->path[i];
+    if (walk->cheapest[walk->link[x]] < walk->cheapest[x]) walk->cheapest[x] = walk->cheapest[walk->link[x]];
+    walk->link[x] = root;
+  }
+  return length == 0 ? FOREST_COST_MAX : walk->cheapest[walk->path[0]];
+}
+
+/**
+ * Lists items by key in a compressed array: offsets[key] to offsets[key + 1] index the items of the key.
+ */
+static void forest_group(int n, int *offsets, int count, const int keys[count], int *items, const int values[count]) {
+  memset(offsets, 0, sizeof(int) * (n + 1));
+  for (int i = 0; i < count; ++i) offsets[keys[i]]++;
+  pool_prefix_sum(solver_pool, (size_t) n + 1, offsets);
+  for (int i = 0; i < count; ++i) items[offsets[keys[i]]++] = values[i];
+  for (int u = n; u > 0; --u) offsets[u] = offsets[u - 1];
+  offsets[0] = 0;
+}
+
+/**
+ * Finds which query bridges could still be in a maximum spanning forest of the forest and the query bridges, i.e.
+ * those which aren't cheaper than every bridge on the path between their islands in the forest. Ties are kept.
+ *
+ * @param n the number of islands.
+ * @param k the number of bridges of the forest.
+ * @param forest the bridges of the forest, without cycles.
+ * @param q the number of query bridges.
+ * @param queries the query bridges.
+ * @param keep set for each query bridge to whether it could be in the forest.
+ * @return the number of query bridges kept, or -1 if we ran out of memory.
+ */
+int forest_filter(int n, int k, const bridge_t forest[k], int q, const bridge_t queries[q], bool keep[q]) {
+  forest_walk_t walk;
+  int *keys = calloc(2 * (size_t) (k > q ? k : q) + 1, sizeof(int));
+  int *values = calloc(2 * (size_t) (k > q ? k : q) + 1, sizeof(int));
+  walk.offsets = malloc(sizeof(int) * (n + 1));
+  walk.neighbors = malloc(sizeof(int) * (2 * (size_t) k + 1));
+  walk.costs = malloc(sizeof(uint_fast32_t) * (2 * (size_t) k + 1));
+  walk.query_offsets = malloc(sizeof(int) * (n + 1));
+  walk.queries = malloc(sizeof(int) * (2 * (size_t) q + 1));
+  walk.link = malloc(sizeof(int) * (n + 1));
+  walk.cheapest = malloc(sizeof(uint_fast32_t) * (n + 1));
+  walk.parent = malloc(sizeof(int) * (n + 1));
+  walk.up = malloc(sizeof(uint_fast32_t) * (n + 1));
+  walk.tree = malloc(sizeof(int) * (n + 1));
+  walk.finished = malloc(sizeof(bool) * (n + 1));
+  walk.bucket = malloc(sizeof(int) * (n + 1));
+  walk.next = malloc(sizeof(int) * (q + 1));
+  walk.stack = malloc(sizeof(int) * (n + 1));
+  walk.cursor = malloc(sizeof(int) * (n + 1));
+  walk.path = malloc(sizeof(int) * (n + 1));
+  int kept = -1;
+  if (keys != NULL && values != NULL && walk.offsets != NULL && walk.neighbors != NULL && walk.costs != NULL &&
+      walk.query_offsets != NULL && walk.queries != NULL && walk.link != NULL && walk.cheapest != NULL &&
+      walk.parent != NULL && walk.up != NULL && walk.tree != NULL && walk.finished != NULL && walk.bucket != NULL &&
+      walk.next != NULL && walk.stack != NULL && walk.cursor != NULL && walk.path != NULL) {
+    // The bridges of the forest, in both directions. The costs follow the same order as the neighbors.
+    for (int i = 0; i < k; ++i) {
+      keys[2 * i] = (int) forest[i].from;
+      keys[2 * i + 1] = (int) forest[i].to;
+      values[2 * i] = 2 * i;
+      values[2 * i + 1] = 2 * i + 1;
+    }
+    forest_group(n, walk.offsets, 2 * k, keys, walk.neighbors, values);
+    for (int j = 0; j < 2 * k; ++j) {
+      int i = walk.neighbors[j];
+      walk.costs[j] = forest[i / 2].cost;
+      walk.neighbors[j] = (int) (i % 2 == 0 ? forest[i / 2].to : forest[i / 2].from);
+    }
+
+    // The queries, on both of their islands. A bridge from an island to itself is never in a forest.
+    int count = 0;
+    for (int i = 0; i < q; ++i) {
+      keep[i] = queries[i].from != queries[i].to;
+      if (!keep[i]) continue;
+      keys[count] = (int) queries[i].from;
+      values[count++] = i;
+      keys[count] = (int) queries[i].to;
+      values[count++] = i;
+    }
+    forest_group(n, walk.query_offsets, count, keys, walk.queries, values);
+
+    for (int u = 0; u < n; ++u) {
+      walk.link[u] = u;
+      walk.tree[u] = -1;
+      walk.finished[u] = false;
+      walk.bucket[u] = -1;
+    }
+
+    for (int root = 0; root < n; ++root) {
+      if (walk.tree[root] >= 0) continue;
+      int depth = 0;
+      walk.stack[depth++] = root;
+      walk.tree[root] = root;
+      walk.parent[root] = -1;
+      walk.cursor[root] = walk.offsets[root];
+      while (depth > 0) {
+        int x = walk.stack[depth - 1];
+        if (walk.cursor[x] < walk.offsets[x + 1]) {
+          int j = walk.cursor[x]++;
+          int y = walk.neighbors[j];
+          if (y == walk.parent[x]) continue;
+          walk.tree[y] = root;
+          walk.parent[y] = x;
+          walk.up[y] = walk.costs[j];
+          walk.cursor[y] = walk.offsets[y];
+          walk.stack[depth++] = y;
+          continue;
+        }
+
+        // The island is finished: each query whose other island finished too goes to their lowest common ancestor.
+        depth--;
+        walk.finished[x] = true;
+        for (int j = walk.query_offsets[x]; j < walk.query_offsets[x + 1]; ++j) {
+          int i = walk.queries[j];
+          int y = (int) (queries[i].from == x ? queries[i].to : queries[i].from);
+          if (y == x || !walk.finished[y] || walk.tree[y] != root) continue;
+          forest_cheapest(&walk, y);
+          int ancestor = walk.link[y];
+          walk.next[i] = walk.bucket[ancestor];
+          walk.bucket[ancestor] = i;
+        }
+        for (int i = walk.bucket[x]; i >= 0; i = walk.next[i]) {
+          uint_fast32_t from = forest_cheapest(&walk, (int) queries[i].from);
+          uint_fast32_t to = forest_cheapest(&walk, (int) queries[i].to);
+          keep[i] = queries[i].cost >= (from < to ? from : to);
+        }
+        if (walk.parent[x] >= 0) {
+          walk.link[x] = walk.parent[x];
+          walk.cheapest[x] = walk.up[x];
+        }
+      }
+    }
+
+    kept = 0;
+    for (int i = 0; i < q; ++i) kept += keep[i];
+  }
+  free(keys);
+  free(values);
+  free(walk.offsets);
+  free(walk.neighbors);
+  free(walk.costs);
+  free(walk.query_offsets);
+  free(walk.queries);
+  free(walk.link);
+  free(walk.cheapest);
+  free(walk.parent);
+  free(walk.up);
+  free(walk.tree);
+  free(walk.finished);
+  free(walk.bucket);
+  free(walk.next);
+  free(walk.stack);
+  free(walk.cursor);
+  free(walk.path);
+  return kept;
+}
+
+// KARGER-KLEIN-TARJAN
+
+/*
+ * The randomized algorithm of Karger, Klein and Tarjan runs in expected linear time. Two Borůvka rounds contract the
+ * network to at most a quarter of its islands, then a forest of a random half of the remaining bridges is found
+ * recursively. The bridges it proves irrelevant are dropped, and the forest of the rest is found recursively too. In
+ * expectation, only 2n bridges survive the filter, so the total work stays linear in m.
+ *
+ * Each level works on its own copy of the bridges, and reports the positions of the bridges it selects, so the callers
+ * can go back to the bridges between their own islands. Small levels are sorted and solved by Kruskal's algorithm.
+ */
+
+#define KKT_BASE 4096   // The number of bridges below which a level is solved by Kruskal's algorithm.
+
+/**
+ * The state shared by the levels of the recursion.
+ */
+typedef struct kkt {
+  int levels;       // The number of radix levels needed by the costs.
+  uint64_t random;  // The state of the generator sampling the bridges.
+} kkt_t;
+
+/**
+ * Generates the next 64 random bits (SplitMix64).
+ */
+static inline uint64_t kkt_random(kkt_t *kkt) {
+  uint64_t z = (kkt->random += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/**
+ * Solves a small level by sorting the positions of its bridges by cost.
+ */
+static int kkt_kruskal(kkt_t *kkt, int n, int m, const bridge_t bridges[m], int selected[]) {
+  if (m <= 0) return 0;
+  bridge_t *sorted = malloc(sizeof(bridge_t) * (m + 1));
+  uf_item_t *uf = uf_alloc(n + 1);
+  int k = -1;
+  if (sorted != NULL && uf != NULL) {
+    for (int i = 0; i < m; ++i) {
+      sorted[i].from = i;
+      sorted[i].to = i;
+      sorted[i].cost = bridges[i].cost;
+    }
+    if (radix_sort_increasing_levels(m, kkt->levels, sorted)) {
+      k = 0;
+      uf_init(n, uf);
+      for (int i = m - 1; i >= 0; --i) {
+        int j = (int) sorted[i].from;
+        int fr = uf_find(uf, bridges[j].from);
+        int tr = uf_find(uf, bridges[j].to);
+        if (fr != tr) {
+          uf_union_r(uf, fr, tr);
+          selected[k++] = j;
+        }
+      }
+    }
+  }
+  free(sorted);
+  uf_free(uf);
+  return k;
+}
+
+/**
+ * Whether the bridge at position i is picked over the one at position j by a Borůvka round, or j is -1. Ties are
+ * broken as in the Borůvka engine, and the levels keep the bridges in the order of the input as well.
+ */
+static inline bool kkt_better(const bridge_t bridges[], int i, int j) {
+  return j < 0 || bridges[j].cost < bridges[i].cost || (bridges[j].cost == bridges[i].cost && i < j);
+}
+
+/**
+ * Finds a maximum spanning forest.
+ *
+ * @param n the number of islands.
+ * @param m the number of bridges.
+ * @param bridges the bridges, between islands in [0, n).
+ * @param selected set to the positions of the bridges of the forest.
+ * @return the number of bridges of the forest, or -1 if we ran out of memory.
+ */
+static int kkt_solve(kkt_t *kkt, int n, int m, const bridge_t bridges[m], int selected[]) {
+  if (m <= KKT_BASE) return kkt_kruskal(kkt, n, m, bridges, selected);
+
+  int *component = malloc(sizeof(int) * (n + 1));
+  int *best = malloc(sizeof(int) * (n + 1));
+  int *label = malloc(sizeof(int) * (n + 1));
+  uf_item_t *uf = uf_alloc(n + 1);
+  int *alive = malloc(sizeof(int) * (m + 1));
+  bridge_t *contracted = malloc(sizeof(bridge_t) * (m + 1));
+  bridge_t *sample = malloc(sizeof(bridge_t) * (m + 1));
+  bridge_t *forest = malloc(sizeof(bridge_t) * (n + 1));
+  int *positions = malloc(sizeof(int) * (m + 1));
+  bool *keep = malloc(sizeof(bool) * (m + 1));
+  int k = -1;
+  if (component == NULL || best == NULL || label == NULL || uf == NULL || alive == NULL || contracted == NULL ||
+      sample == NULL || forest == NULL || positions == NULL || keep == NULL) {
+    goto out;
+  }
+
+  // Two Borůvka rounds, on the positions of the bridges which still join two components.
+  k = 0;
+  int c = n, count = 0;
+  for (int u = 0; u < n; ++u) component[u] = u;
+  for (int i = 0; i < m; ++i) {
+    if (bridges[i].from != bridges[i].to) alive[count++] = i;
+  }
+  for (int round = 0; round < 2 && count > 0; ++round) {
+    for (int u = 0; u < c; ++u) best[u] = -1;
+    for (int a = 0; a < count; ++a) {
+      int i = alive[a];
+      int from = component[bridges[i].from], to = component[bridges[i].to];
+      if (kkt_better(bridges, i, best[from])) best[from] = i;
+      if (kkt_better(bridges, i, best[to])) best[to] = i;
+    }
+    uf_init(c, uf);
+    for (int u = 0; u < c; ++u) {
+      int i = best[u];
+      if (i < 0) continue;
+      int fr = uf_find(uf, component[bridges[i].from]);
+      int tr = uf_find(uf, component[bridges[i].to]);
+      if (fr != tr) {
+        uf_union_r(uf, fr, tr);
+        selected[k++] = i;
+      }
+    }
+    for (int u = 0; u < c; ++u) label[u] = uf_find(uf, u);
+    for (int u = 0; u < n; ++u) component[u] = label[component[u]];
+    int kept = 0;
+    for (int a = 0; a < count; ++a) {
+      int i = alive[a];
+      if (component[bridges[i].from] != component[bridges[i].to]) alive[kept++] = i;
+    }
+    count = kept;
+  }
+
+  // The contracted network only has the components which still have bridges, so it has at most n / 4 islands.
+  int islands = 0;
+  for (int u = 0; u < n; ++u) label[u] = -1;
+  for (int a = 0; a < count; ++a) {
+    int i = alive[a];
+    int from = component[bridges[i].from], to = component[bridges[i].to];
+    if (label[from] < 0) label[from] = islands++;
+    if (label[to] < 0) label[to] = islands++;
+    contracted[a].from = label[from];
+    contracted[a].to = label[to];
+    contracted[a].cost = bridges[i].cost;
+    contracted[a].index = bridges[i].index;
+  }
+  if (count == 0) goto out;
+
+  // The forest of a random half of the bridges filters the others.
+  int sampled = 0;
+  for (int a = 0; a < count; a += 64) {
+    uint64_t bits = kkt_random(kkt);
+    for (int b = a; b < count && b < a + 64; ++b, bits >>= 1) {
+      if (bits & 1) sample[sampled++] = contracted[b];
+    }
+  }
+  int f = kkt_solve(kkt, islands, sampled, sample, positions);
+  if (f < 0) {
+    k = -1;
+    goto out;
+  }
+  for (int j = 0; j < f; ++j) forest[j] = sample[positions[j]];
+  if (forest_filter(islands, f, forest, count, contracted, keep) < 0) {
+    k = -1;
+    goto out;
+  }
+  int light = 0;
+  for (int a = 0; a < count; ++a) {
+    if (keep[a]) {
+      alive[light] = alive[a];
+      contracted[light++] = contracted[a];
+    }
+  }
+
+  // The forest of the bridges left completes the one of the Borůvka rounds.
+  f = kkt_solve(kkt, islands, light, contracted, positions);
+  if (f < 0) {
+    k = -1;
+    goto out;
+  }
+  for (int j = 0; j < f; ++j) selected[k++] = alive[positions[j]];
+
+out:
+  free(component);
+  free(best);
+  free(label);
+  uf_free(uf);
+  free(alive);
+  free(contracted);
+  free(sample);
+  free(forest);
+  free(positions);
+  free(keep);
+  return k;
+}
+
+/**
+ * Runs the Karger-Klein-Tarjan algorithm on some bridges.
+ *
+ * @param levels the number of radix levels needed by the costs.
+ * @return the number of selected bridges, which are stored in bridges[m - k] to bridges[m - 1], or -1 if we ran out
+ *         of memory.
+ */
+int kkt(int n, int m, int levels, bridge_t bridges[m], bridge_t buffer[m]) {
+  int *selected = malloc(sizeof(int) * (n + 1));
+  kkt_t state = {levels, 0x3C6EF372FE94F82AULL};
+  int k = selected == NULL ? -1 : kkt_solve(&state, n, m, bridges, selected);
+  for (int j = 0; j < k; ++j) buffer[j] = bridges[selected[j]];
+  if (k > 0) memcpy(bridges + m - k, buffer, sizeof(bridge_t) * k);
+  free(selected);
+  return k;
+}
+
+// KRUSKAL BY KEY BUCKETS
+
+/*
+ * Kruskal's algorithm can handle each run of bridges of equal key as a batch. The roots of the islands of a whole batch
+ * are found first, in a loop without dependencies between the bridges which walks all the islands one parent step at a
+ * time, with 8-wide gathers when AVX2 is available. A bridge whose islands already had the same root before the batch
+ * is skipped without another find, which is the case of most bridges of a dense network; the others find their roots
+ * again from the cached ones, which is short, and are merged. The bridges of a batch are still taken by increasing
+ * index, so the forest is the same as with the other engines.
+ *
+ * Costs which fit in 16 bits are put in their buckets by a single counting pass, while rank-compressed costs are
+ * radix sorted.
+ */
+
+#define BUCKETS_BATCH 1024   // The largest number of bridges handled as one batch.
+
+/**
+ * Replaces each island by its root in the union-find array.
+ */
+static void buckets_roots_scalar(uf_item_t *uf, int count, int islands[count]) {
+  for (int i = 0; i < count; ++i) islands[i] = uf_find(uf, islands[i]);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BUCKETS_AVX2 1
+
+__attribute__((target("avx2"))) static void buckets_roots_avx2(uf_item_t *uf, int count, int islands[count]) {
+  // The parents are every other int of the union-find array. The gather scales the islands by the size of an item
+  // itself, as doubling them would overflow from 2^30 islands.
+  const int *parents = &uf[0].parent;
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i u = _mm256_loadu_si256((const __m256i *) (islands + i));
+    for (;;) {
+      __m256i parent = _mm256_i32gather_epi32(parents, u, sizeof(uf_item_t));
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(parent, u)) == -1) break;
+      u = parent;
+    }
+    _mm256_storeu_si256((__m256i *) (islands + i), u);
+  }
+  buckets_roots_scalar(uf, count - i, islands + i);
+}
+#endif
+
+/**
+ * Sorts bridges whose costs fit in 16 bits by increasing cost, with a single counting pass. Like the radix sort, the
+ * bridges of equal cost come out by decreasing index.
+ *
+ * @return false if we ran out of memory.
+ */
+static bool buckets_sort(int m, const bridge_t bridges[m], bridge_t sorted[m]) {
+  int *indices = calloc(1 << 16, sizeof(int));
+  if (indices == NULL) return false;
+  for (int i = 0; i < m; ++i) indices[bridges[i].cost]++;
+  pool_prefix_sum(solver_pool, 1 << 16, indices);
+  // Each bucket is filled down from the start of the next one.
+  for (int key = 0; key < (1 << 16) - 1; ++key) indices[key] = indices[key + 1];
+  indices[(1 << 16) - 1] = m;
+  for (int i = 0; i < m; ++i) sorted[--indices[bridges[i].cost]] = bridges[i];
+  free(indices);
+  return true;
+}
+
+/**
+ * Runs Kruskal's algorithm over batches of bridges of equal key.
+ *
+ * @param levels the number of radix levels needed by the costs.
+ * @param bridges the bridges, in any order, which get overwritten.
+ * @param buffer a buffer of m bridges.
+ * @return the number of selected bridges, which are stored in bridges[m - k] to bridges[m - 1], or -1 if we ran out
+ *         of memory.
+ */
+int kruskal_buckets(int n, int m, int levels, bridge_t bridges[m], bridge_t buffer[m]) {
+  uf_item_t *uf = uf_alloc(n + 1);
+  bool ok = uf != NULL;
+  if (ok && levels <= 2) {
+    ok = buckets_sort(m, bridges, buffer);
+  } else if (ok) {
+    radix_sort_increasing_buffer(m, levels, bridges, buffer);
+    memcpy(buffer, bridges, sizeof(bridge_t) * m);
+  }
+  if (!ok) {
+    uf_free(uf);
+    return -1;
+  }
+
+  void (*roots)(uf_item_t *uf, int count, int islands[count]) = buckets_roots_scalar;
+#ifdef BUCKETS_AVX2
+  if (__builtin_cpu_supports("avx2")) roots = buckets_roots_avx2;
+#endif
+
+  // The sorted bridges are in the buffer, so the selected ones can go to the end of the bridges.
+  int k = 0;
+  int islands[2 * BUCKETS_BATCH];
+  uf_init(n, uf);
+  for (int hi = m; hi > 0;) {
+    uint_fast32_t key = buffer[hi - 1].cost;
+    int lo = hi - 1;
+    while (lo > 0 && buffer[lo - 1].cost == key && hi - lo < BUCKETS_BATCH) lo--;
+    for (int i = lo; i < hi; ++i) {
+      islands[2 * (i - lo)] = (int) buffer[i].from;
+      islands[2 * (i - lo) + 1] = (int) buffer[i].to;
+    }
+    roots(uf, 2 * (hi - lo), islands);
+    for (int i = hi - 1; i >= lo; --i) {
+      int fr = islands[2 * (i - lo)];
+      int tr = islands[2 * (i - lo) + 1];
+      if (fr == tr) continue;
+      fr = uf_find(uf, fr);
+      tr = uf_find(uf, tr);
+      if (fr != tr) {
+        uf_union_r(uf, fr, tr);
+        bridges[m - 1 - k++] = buffer[i];
+      }
+    }
+    hi = lo;
+  }
+  uf_free(uf);
+  return k;
+}
+
+// CONNECTED COMPONENTS
+
+/*
+ * When only the number of connected components is needed, the costs don't matter and nothing has to be sorted. The
+ * bridges are merged by a concurrent union-find in the style of Shiloach-Vishkin: a root is only ever hooked below a
+ * smaller root with a compare-and-swap, so the threads can merge the chunks of bridges at the same time, and the finds
+ * halve the paths they walk. Once all the bridges are merged, the roots left are counted.
+ */
+
+#define COMPONENTS_CHUNK (64 * 1024)   // The number of bridges, or islands, in each job of a parallel loop.
+
+/**
+ * The state of a component count, shared by the jobs of its parallel loops.
+ */
+typedef struct components {
+  int n, m;
+  const bridge_t *bridges;
+  atomic_int *parent;
+  atomic_int roots;
+} components_t;
+
+/**
+ * Finds the root of an island, pointing each island on the way to its grandparent. Another thread may hook the root
+ * below another one at any time, so the root found may already be stale.
+ */
+static int components_find(atomic_int *parent, int u) {
+  for (;;) {
+    int p = atomic_load_explicit(&parent[u], memory_order_relaxed);
+    if (p == u) return u;
+    int g = atomic_load_explicit(&parent[p], memory_order_relaxed);
+    if (g != p) atomic_store_explicit(&parent[u], g, memory_order_relaxed);
+    u = g;
+  }
+}
+
+static void components_union(atomic_int *parent, int u, int v) {
+  for (;;) {
+    u = components_find(parent, u);
+    v = components_find(parent, v);
+    if (u == v) return;
+    if (u < v) {
+      int t = u;
+      u = v;
+      v = t;
+    }
+    // Hooks the larger root below the smaller one, unless it isn't a root anymore.
+    int expected = u;
+    if (atomic_compare_exchange_weak_explicit(&parent[u], &expected, v, memory_order_relaxed, memory_order_relaxed)) {
+      return;
+    }
+  }
+}
+
+static void components_union_job(void *context, size_t chunk) {
+  components_t *count = context;
+  size_t end = (chunk + 1) * COMPONENTS_CHUNK < (size_t) count->m ? (chunk + 1) * COMPONENTS_CHUNK : (size_t) count->m;
+  for (size_t i = chunk * COMPONENTS_CHUNK; i < end; ++i) {
+    components_union(count->parent, (int) count->bridges[i].from, (int) count->bridges[i].to);
+  }
+}
+
+static void components_count_job(void *context, size_t chunk) {
+  components_t *count = context;
+  size_t end = (chunk + 1) * COMPONENTS_CHUNK < (size_t) count->n ? (chunk + 1) * COMPONENTS_CHUNK : (size_t) count->n;
+  int roots = 0;
+  for (size_t u = chunk * COMPONENTS_CHUNK; u < end; ++u) {
+    roots += atomic_load_explicit(&count->parent[u], memory_order_relaxed) == (int) u;
+  }
+  atomic_fetch_add_explicit(&count->roots, roots, memory_order_relaxed);
+}
+
+/**
+ * Counts the connected components of the islands joined by some bridges, in any order.
+ *
+ * @param pool the pool for the parallel loops, or NULL.
+ * @return the number of components, or -1 if we ran out of memory.
+ */
+int components_count(pool_t *pool, int n, int m, const bridge_t bridges[m]) {
+  components_t count = {n, m, bridges, malloc(sizeof(atomic_int) * (n + 1)), 0};
+  if (count.parent == NULL) return -1;
+  for (int u = 0; u < n; ++u) atomic_init(&count.parent[u], u);
+  pool_run_chunks(pool, (size_t) m, COMPONENTS_CHUNK, components_union_job, &count);
+  pool_run_chunks(pool, (size_t) n, COMPONENTS_CHUNK, components_count_job, &count);
+  free(count.parent);
+  return atomic_load(&count.roots);
+}
+
+// ISLAND IDENTIFIERS
+
+/*
+ * By default, the islands are numbered from 1 to n. Networks whose islands have arbitrary 64-bit identifiers, such as
+ * hashes, are densified as they are parsed: an open-addressing hash table maps each identifier to the next free index.
+ * Islands which no bridge joins are then unknown, which doesn't change the totals, but does change the number of
+ * components.
+ *
+ * Islands may also be named by strings. The same table then maps the hash of each name to its index, and the names
+ * are interned in an arena owned by the map: each one is copied once, when it is first seen.
+ */
+
+/**
+ * How the islands of the instances read as text are identified.
+ */
+typedef enum island_ids {
+  ISLAND_IDS_DENSE,    // Numbers from 1 to n.
+  ISLAND_IDS_SPARSE,   // Arbitrary unsigned 64-bit numbers.
+  ISLAND_IDS_NAMES,    // Strings without whitespace.
+} island_ids_t;
+
+island_ids_t island_ids = ISLAND_IDS_DENSE;
+
+#define ISLAND_NAME_INLINE 16   // The number of bytes of a name kept in its slot.
+
+/**
+ * A slot of an island map. Short names are compared within the slot, so a lookup usually misses the cache only once.
+ */
+typedef struct island_slot {
+  uint64_t key;         // The identifier, or the hash of the name.
+  int island;           // The index of the island, or -1 for an empty slot.
+  uint32_t length;      // The length of the name.
+  char prefix[ISLAND_NAME_INLINE];   // The start of the name.
+} island_slot_t;
+
+/**
+ * A map from identifiers to dense island indices, kept at most half full.
+ */
+typedef struct island_map {
+  island_slot_t *slots;
+  size_t capacity;    // The number of slots, a power of two.
+  int count;          // The number of islands so far.
+  char **names;       // The interned name of each island by index, or NULL if the islands aren't named.
+  bool named;
+  arena_t strings;    // The interned names.
+} island_map_t;
+
+static inline size_t island_map_slot(const island_map_t *map, uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDULL;
+  key ^= key >> 33;
+  return (size_t) key & (map->capacity - 1);
+}
+
+/**
+ * Hashes a name 8 bytes at a time.
+ */
+static inline uint64_t island_name_hash(const char *name, size_t length) {
+  uint64_t hash = 0x9E3779B97F4A7C15ULL ^ length;
+  while (length > 0) {
+    uint64_t word = 0;
+    size_t size = length < sizeof(word) ? length : sizeof(word);
+    memcpy(&word, name, size);
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 32;
+    name += size;
+    length -= size;
+  }
+  return hash;
+}
+
+/**
+ * Allocates the slots of a map of the given capacity, and the names of the islands it can hold if they are named.
+ *
+ * @return false if we ran out of memory.
+ */
+static bool island_map_alloc(island_map_t *map, size_t capacity) {
+  map->capacity = capacity;
+  map->slots = malloc(sizeof(island_slot_t) * capacity);
+  char **names = map->named ? realloc(map->names, sizeof(char *) * (capacity / 2)) : NULL;
+  if (names != NULL) map->names = names;
+  if (map->slots == NULL || (map->named && names == NULL)) return false;
+  for (size_t slot = 0; slot < capacity; ++slot) map->slots[slot].island = -1;
+  return true;
+}
+
+/**
+ * Creates an empty map.
+ *
+ * @param expected the number of islands expected, to size the map.
+ * @param named whether the islands are named by strings.
+ * @return false if we ran out of memory.
+ */
+bool island_map_init(island_map_t *map, size_t expected, bool named) {
+  size_t capacity = 16;
+  while (capacity < 2 * expected) capacity <<= 1;
+  map->count = 0;
+  map->names = NULL;
+  map->named = named;
+  arena_init(&map->strings);
+  return island_map_alloc(map, capacity);
+}
+
+/**
+ * Doubles the capacity of a map, moving its islands to their new slots.
+ *
+ * @return false if we ran out of memory.
+ */
+static bool island_map_grow(island_map_t *map) {
+  island_slot_t *slots = map->slots;
+  size_t capacity = map->capacity;
+  bool ok = island_map_alloc(map, 2 * capacity);
+  for (size_t i = 0; ok && i < capacity; ++i) {
+    if (slots[i].island < 0) continue;
+    size_t slot = island_map_slot(map, slots[i].key);
+    while (map->slots[slot].island >= 0) slot = (slot + 1) & (map->capacity - 1);
+    map->slots[slot] = slots[i];
+  }
+  free(slots);
+  return ok;
+}
+
+/**
+ * Whether the island of a slot has the given name.
+ */
+static inline bool island_slot_named(const island_map_t *map, const island_slot_t *slot, const char *name,
+                                     size_t length) {
+  if (slot->length != length) return false;
+  if (length <= ISLAND_NAME_INLINE) return memcmp(slot->prefix, name, length) == 0;
+  return memcmp(slot->prefix, name, ISLAND_NAME_INLINE) == 0 &&
+         memcmp(map->names[slot->island] + ISLAND_NAME_INLINE, name + ISLAND_NAME_INLINE,
+                length - ISLAND_NAME_INLINE) == 0;
+}
+
+/**
+ * Finds the index of the island with the given key, giving it the next free index if it is new.
+ *
+ * @param name the name of the island, which must match too, or NULL if the islands aren't named.
+ * @return the index of the island, or -1 if we ran out of memory.
+ */
+static int island_map_find(island_map_t *map, uint64_t key, const char *name, size_t length) {
+  size_t slot = island_map_slot(map, key);
+  for (island_slot_t *s = &map->slots[slot]; s->island >= 0; s = &map->slots[slot]) {
+    if (s->key == key && (name == NULL || island_slot_named(map, s, name, length))) return s->island;
+    slot = (slot + 1) & (map->capacity - 1);
+  }
+  if (unlikely(2 * (size_t) (map->count + 1) > map->capacity)) {
+    if (!island_map_grow(map)) return -1;
+    return island_map_find(map, key, name, length);
+  }
+  if (name != NULL) {
+    char *interned = arena_alloc(&map->strings, length + 1);
+    if (interned == NULL) return -1;
+    memcpy(interned, name, length);
+    interned[length] = '\0';
+    map->names[map->count] = interned;
+    map->slots[slot].length = (uint32_t) length;
+    memcpy(map->slots[slot].prefix, name, length < ISLAND_NAME_INLINE ? length : ISLAND_NAME_INLINE);
+  }
+  map->slots[slot].key = key;
+  map->slots[slot].island = map->count;
+  return map->count++;
+}
+
+/**
+ * Parses the next island of an instance whose islands aren't numbered from 1 to n.
+ *
+ * @return the index of the island, or -1 if we ran out of memory.
+ */
+int island_map_scan(island_map_t *map, scanner_t *s) {
+  if (!map->named) {
+    uint64_t id = scan_u64(s);
+    return island_map_find(map, id, NULL, 0);
+  }
+  size_t length;
+  const char *name = scan_token(s, &length);
+  return island_map_find(map, island_name_hash(name, length), name, length);
+}
+
+void island_map_free(island_map_t *map) {
+  free(map->slots);
+  free(map->names);
+  arena_free(&map->strings);
+}
+
+// INSTANCES
+
+/**
+ * The algorithms which can solve an instance.
+ */
+typedef enum solver_engine {
+  ENGINE_KRUSKAL,   // Radix sort, then Kruskal's algorithm.
+  ENGINE_BORUVKA,   // Borůvka's algorithm with contraction, which doesn't sort.
+  ENGINE_KKT,       // The randomized linear-time algorithm of Karger, Klein and Tarjan.
+  ENGINE_BUCKETS,   // Kruskal's algorithm over batches of bridges of equal key.
+} solver_engine_t;
+
+// The algorithm solving the instances read as text.
+solver_engine_t solver_engine = ENGINE_KRUSKAL;
+
+// The file to which the forest of the instance read as text is written, or NULL.
+const char *forest_path = NULL;
+
+/**
+ * An instance of the problem, as it gets parsed.
+ */
+typedef struct instance {
+  int n, m;
+  bridge_t *bridges;
+  uint64_t *wide;   // The order-preserving keys of the costs, only allocated once some cost does not fit.
+  bool real;        // Whether the keys in wide are floating-point keys.
+  arena_t *arena;   // The arena for the bridges and the solver buffers, or NULL to use malloc.
+  island_map_t *islands;  // The map densifying the identifiers of the islands, or NULL if they are already dense.
+} instance_t;
+
+/**
+ * Allocates memory for an instance, from its arena if it has one.
+ */
+static void *instance_alloc(const instance_t *instance, size_t size) {
+  return instance->arena != NULL ? arena_alloc(instance->arena, size) : malloc(size);
+}
+
+/**
+ * Releases memory allocated with instance_alloc.
+ */
+static void instance_release(const instance_t *instance, void *memory) {
+  if (instance->arena == NULL) free(memory);
+}
+
+/**
+ * Parses the header of an instance, and allocates its bridges.
+ *
+ * @param arena the arena to allocate from, or NULL to use malloc.
+ * @return false if we ran out of memory.
+ */
+bool instance_init(instance_t *instance, scanner_t *s, arena_t *arena) {
+  scan_reserve(s);
+  instance->n = scan_int(s);
+  instance->m = scan_int(s);
+  instance->wide = NULL;
+  instance->real = false;
+  instance->arena = arena;
+  instance->islands = NULL;
+  instance->bridges = instance_alloc(instance, sizeof(bridge_t) * (instance->m + 1));
+  return instance->bridges != NULL;
+}
+
+/**
+ * Makes an instance densify the identifiers of its islands with a map, unless they are numbered from 1 to n. The n of
+ * the header is only used to size the map, and becomes the number of distinct identifiers once parsed.
+ *
+ * @return false if we ran out of memory.
+ */
+bool instance_map_islands(instance_t *instance, island_map_t *map) {
+  if (island_ids == ISLAND_IDS_DENSE) return true;
+  instance->islands = map;
+  return island_map_init(map, (size_t) (instance->n > 0 ? instance->n : 0), island_ids == ISLAND_IDS_NAMES);
+}
+
+/*
+ * The parser writes the plain costs in the bridges, and the companies to a column of bytes, one block of lines at a
+ * time. The keys of each block are then built at once, while its bridges are still in cache: the red bit is moved to
+ * its place in the cost, eight bridges at a time when AVX2 is available.
+ */
+
+#define INSTANCE_BLOCK 4096   // The number of lines parsed before their keys are built.
+
+/**
+ * Builds the keys of some bridges from their plain costs and whether their company is red (0 or 1).
+ */
+static void instance_keys_scalar(int count, bridge_t bridges[count], const uint8_t reds[count]) {
+  for (int i = 0; i < count; ++i) bridges[i].cost |= (uint32_t) reds[i] << BRIDGE_RED_SHIFT;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define INSTANCE_KEYS_AVX2 1
+
+__attribute__((target("avx2"))) static void instance_keys_avx2(int count, bridge_t bridges[count],
+                                                                 const uint8_t reds[count]) {
+  // A vector holds two bridges, whose costs are its words 2 and 6. Each pair gets its two red bits from the eight
+  // loaded at once, moved to those words.
+  const __m256i costs = _mm256_setr_epi32(0, 0, -1, 0, 0, 0, -1, 0);
+  int i = 0;
+  if (sizeof(bridge_t) == 4 * sizeof(uint32_t) && offsetof(bridge_t, cost) == 2 * sizeof(uint32_t)) {
+    for (; i + 8 <= count; i += 8) {
+      long long bytes;
+      memcpy(&bytes, reds + i, sizeof(bytes));
+      __m256i bits = _mm256_slli_epi32(_mm256_cvtepu8_epi32(_mm_cvtsi64_si128(bytes)), BRIDGE_RED_SHIFT);
+      for (int pair = 0; pair < 4; ++pair) {
+        __m256i spread = _mm256_setr_epi32(0, 0, 2 * pair, 0, 0, 0, 2 * pair + 1, 0);
+        __m256i *p = (__m256i *) (bridges + i + 2 * pair);
+        __m256i red = _mm256_and_si256(_mm256_permutevar8x32_epi32(bits, spread), costs);
+        _mm256_storeu_si256(p, _mm256_or_si256(_mm256_loadu_si256(p), red));
+      }
+    }
+  }
+  instance_keys_scalar(count - i, bridges + i, reds + i);
+}
+#endif
+
+/**
+ * Parses the lines of a block, writing whether the company of each bridge is red to reds.
+ *
+ * @return false if we ran out of memory.
+ */
+static bool instance_parse_block(instance_t *instance, scanner_t *s, int begin, int end, uint8_t reds[]) {
+  bridge_t *bridges = instance->bridges;
+  for (int i = begin; i < end; i++) {
+    scan_reserve(s);
+    int_fast32_t from, to;
+    if (likely(instance->islands == NULL)) {
+      from = (int_fast32_t) scan_int(s);
+      to = (int_fast32_t) scan_int(s);
+    } else {
+      from = (int_fast32_t) island_map_scan(instance->islands, s) + 1;
+      to = (int_fast32_t) island_map_scan(instance->islands, s) + 1;
+      if (unlikely(from == 0 || to == 0)) return false;
+    }
+    long long cost = 0;
+    double cost_real = 0.0;
+    bool floating = scan_cost(s, &cost, &cost_real);
+    reds[i - begin] = (uint8_t) (scan_company(s) >> BRIDGE_RED_SHIFT);
+
+    if (unlikely(instance->wide != NULL || floating || cost < 0 || cost > BRIDGE_MASK_COST)) {
+      uint64_t *wide = instance->wide;
+      if (wide == NULL) {
+        wide = instance->wide = malloc(sizeof(uint64_t) * instance->m);
+        if (wide == NULL) return false;
+        for (int j = 0; j < i; j++) wide[j] = ranks_key_of_long(bridges[j].cost & BRIDGE_MASK_COST);
+      }
+      // Once a floating-point cost is seen, all the keys are floating-point keys.
+      if (floating && !instance->real) {
+        for (int j = 0; j < i; j++) wide[j] = ranks_key_of_double((double) ranks_long_of_key(wide[j]));
+        instance->real = true;
+      }
+      if (instance->real) {
+        wide[i] = ranks_key_of_double(floating ? cost_real : (double) cost);
+      } else {
+        wide[i] = ranks_key_of_long(cost);
+      }
+      cost = 0;
+    }
+
+    bridges[i].from = from - 1;
+    bridges[i].to = to - 1;
+    bridges[i].cost = (uint_fast32_t) cost;
+    bridges[i].index = (uint32_t) i;
+  }
+  return true;
+}
+
+/**
+ * Parses the bridges of an instance in the range [begin, end).
+ *
+ * @return false if we ran out of memory.
+ */
+bool instance_parse(instance_t *instance, scanner_t *s, int begin, int end) {
+  bridge_t *bridges = instance->bridges;
+  void (*keys)(int count, bridge_t bridges[count], const uint8_t reds[count]) = instance_keys_scalar;
+#ifdef INSTANCE_KEYS_AVX2
+  if (__builtin_cpu_supports("avx2")) keys = instance_keys_avx2;
+#endif
+  uint8_t reds[INSTANCE_BLOCK];
+  for (int block = begin; block < end; block += INSTANCE_BLOCK) {
+    int block_end = end - block < INSTANCE_BLOCK ? end : block + INSTANCE_BLOCK;
+    if (!instance_parse_block(instance, s, block, block_end, reds)) return false;
+    keys(block_end - block, bridges + block, reds);
+  }
+  if (instance->islands != NULL) instance->n = instance->islands->count;
+  return true;
+}
+
+/**
+ * Compresses the costs of an instance to rank space if some of them did not fit in BRIDGE_MASK_COST.
+ *
+ * @param ranks the rank table, whose values are set to NULL if no compression was needed.
+ * @return false if we ran out of memory.
+ */
+bool instance_compress(instance_t *instance, cost_ranks_t *ranks) {
+  ranks->values = NULL;
+  if (likely(instance->wide == NULL)) return true;
+  bool ok = ranks_compress(instance->m, instance->bridges, instance->wide, ranks);
+  free(instance->wide);
+  instance->wide = NULL;
+  return ok;
+}
+
+/**
+ * Computes the answer of an instance from the k bridges selected by Kruskal's algorithm.
+ */
+void instance_totals(const instance_t *instance, const cost_ranks_t *ranks, int k, answer_t *answer) {
+  answer->real = instance->real;
+  if (ranks->values == NULL) {
+    answer->result = totals(instance->m, k, instance->bridges);
+  } else if (instance->real) {
+    answer->result_real = totals_ranked_real(instance->m, k, instance->bridges, ranks);
+  } else {
+    answer->result = totals_ranked(instance->m, k, instance->bridges, ranks);
+  }
+}
+
+static int forest_index_compare(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * Writes the positions in the input of the k bridges selected for an instance to forest_path, from 1, one per line and
+ * in increasing order.
+ *
+ * @return false if the file could not be written or we ran out of memory.
+ */
+bool instance_write_forest(const instance_t *instance, int k) {
+  uint32_t *indices = malloc(sizeof(uint32_t) * (k + 1));
+  FILE *file = indices == NULL ? NULL : fopen(forest_path, "w");
+  bool ok = file != NULL;
+  if (ok) {
+    for (int j = 0; j < k; ++j) indices[j] = instance->bridges[instance->m - k + j].index;
+    qsort(indices, k, sizeof(uint32_t), forest_index_compare);
+    for (int j = 0; j < k; ++j) fprintf(file, "%lu\n", (unsigned long) indices[j] + 1);
+    ok = fclose(file) == 0;
+  }
+  free(indices);
+  return ok;
+}
+
+/**
+ * Solves a parsed instance.
+ *
+ * @return false if we ran out of memory.
+ */
+bool instance_solve(instance_t *instance, answer_t *answer) {
+  cost_ranks_t ranks;
+  if (!instance_compress(instance, &ranks)) return false;
+  int levels = ranks.values == NULL ? RADIX_LEVELS : ranks.levels;
+  bridge_t *buffer = instance_alloc(instance, sizeof(bridge_t) * (instance->m + 1));
+  uf_item_t *uf = NULL;
+  bool ok = buffer != NULL;
+  int k = 0;
+  if (ok && solver_engine != ENGINE_KRUSKAL) {
+    if (solver_engine == ENGINE_BORUVKA) {
+      k = boruvka(solver_pool, instance->n, instance->m, instance->bridges, buffer);
+    } else if (solver_engine == ENGINE_KKT) {
+      k = kkt(instance->n, instance->m, levels, instance->bridges, buffer);
+    } else {
+      k = kruskal_buckets(instance->n, instance->m, levels, instance->bridges, buffer);
+    }
+    ok = k >= 0;
+  } else if (ok) {
+    // The other engines allocate their own union-find arrays, if they need one.
+    uf = uf_alloc(instance->n + 1);
+    ok = uf != NULL;
+    if (ok) {
+      radix_sort_increasing_buffer(instance->m, levels, instance->bridges, buffer);
+      uf_init(instance->n, uf);
+      k = kruskal_slice(uf, instance->m, instance->bridges, instance->m, 0, 0);
+    }
+  }
+  if (ok) instance_totals(instance, &ranks, k, answer);
+  if (ok && forest_path != NULL) ok = instance_write_forest(instance, k);
+  instance_release(instance, buffer);
+  uf_free(uf);
+  free(ranks.values);
+  return ok;
+}
+
+void instance_free(instance_t *instance) {
+  instance_release(instance, instance->bridges);
+  free(instance->wide);
+}
+
+// RESUMABLE SOLVER
+
+/**
+ * The phases of a resumable solve.
+ */
+typedef enum solver_phase {
+  SOLVER_PHASE_PARSE,
+  SOLVER_PHASE_COUNT,
+  SOLVER_PHASE_SCATTER,
+  SOLVER_PHASE_KRUSKAL,
+  SOLVER_PHASE_DONE,
+} solver_phase_t;
+
+/**
+ * The outcome of a step of a resumable solve.
+ */
+typedef enum solver_status {
+  SOLVER_PENDING,
+  SOLVER_DONE,
+  SOLVER_FAILED,
+} solver_status_t;
+
+/**
+ * A solve which runs in resumable slices, so an event loop can interleave many of them without ever blocking on a
+ * large instance. Each call to solver_task_step processes a bounded number of bridges before yielding back.
+ *
+ * The input file must be readable without blocking, for instance a request body opened with fmemopen().
+ */
+typedef struct solver_task {
+  scanner_t scanner;
+  instance_t instance;
+  island_map_t islands;
+  cost_ranks_t ranks;
+  solver_phase_t phase;
+  int i;                // The next bridge of the current phase.
+  int level;            // The current radix level.
+  int levels;           // The number of radix levels to sort.
+  int k;                // The number of bridges selected so far.
+  bridge_t *buffer;     // The radix output buffer.
+  uf_item_t *uf;
+  int frequencies[RADIX_LEVELS_MAX][RADIX_SIZE];
+  int indices[RADIX_SIZE];
+  answer_t answer;
+} solver_task_t;
+
+/**
+ * Starts a resumable solve, reading the header of the instance.
+ *
+ * @return false if the input is a delta instance, which can't be solved in slices, or we ran out of memory.
+ */
+bool solver_task_init(solver_task_t *task, FILE *file) {
+  task->phase = SOLVER_PHASE_PARSE;
+  task->i = 0;
+  task->level = 0;
+  task->k = 0;
+  task->buffer = NULL;
+  task->uf = NULL;
+  task->ranks.values = NULL;
+  memset(task->frequencies, 0, sizeof(task->frequencies));
+  memset(&task->islands, 0, sizeof(task->islands));
+  task->instance.bridges = NULL;
+  task->instance.wide = NULL;
+  task->instance.arena = NULL;
+  return scan_init(&task->scanner, file) && !scan_peek(&task->scanner, "delta") &&
+         instance_init(&task->instance, &task->scanner, NULL) && instance_map_islands(&task->instance, &task->islands);
+}
+
+/**
+ * Processes up to budget bridges of the current phase of a resumable solve.
+ *
+ * @return SOLVER_DONE once the answer is available, SOLVER_PENDING if more steps are needed.
+ */
+solver_status_t solver_task_step(solver_task_t *task, int budget) {
+  instance_t *instance = &task->instance;
+  int m = instance->m;
+  int end = task->i + budget < m ? task->i + budget : m;
+
+  switch (task->phase) {
+    case SOLVER_PHASE_PARSE:
+      if (!instance_parse(instance, &task->scanner, task->i, end)) return SOLVER_FAILED;
+      task->i = end;
+      if (end == m) {
+        if (!instance_compress(instance, &task->ranks)) return SOLVER_FAILED;
+        task->levels = task->ranks.values == NULL ? RADIX_LEVELS : task->ranks.levels;
+        task->buffer = malloc(sizeof(bridge_t) * (m + 1));
+        task->uf = uf_alloc(instance->n + 1);
+        if (task->buffer == NULL || task->uf == NULL) return SOLVER_FAILED;
+        task->phase = SOLVER_PHASE_COUNT;
+        task->i = 0;
+      }
+      return SOLVER_PENDING;
+
+    case SOLVER_PHASE_COUNT:
+      radix_compute_frequencies(end - task->i, task->levels, instance->bridges + task->i, task->frequencies);
+      task->i = end;
+      if (end == m) {
+        radix_compute_ends(0, task->frequencies, task->indices);
+        task->phase = SOLVER_PHASE_SCATTER;
+        task->i = 0;
+      }
+      return SOLVER_PENDING;
+
+    case SOLVER_PHASE_SCATTER:
+      radix_scatter(task->i, end, task->level, instance->bridges, task->buffer, task->indices, task->level == 0);
+      task->i = end;
+      if (end == m) {
+        // Swap the bridges and the buffer, and move on to the next level.
+        bridge_t *tmp = instance->bridges;
+        instance->bridges = task->buffer;
+        task->buffer = tmp;
+        task->i = 0;
+        if (++task->level < task->levels) {
+          radix_compute_indices(task->level, task->frequencies, task->indices);
+        } else {
+          uf_init(instance->n, task->uf);
+          task->phase = SOLVER_PHASE_KRUSKAL;
+        }
+      }
+      return SOLVER_PENDING;
+
+    case SOLVER_PHASE_KRUSKAL:
+      // Kruskal goes down from the most expensive bridge, so i counts the bridges processed from the end.
+      task->k = kruskal_slice(task->uf, m, instance->bridges, m - task->i, m - end, task->k);
+      task->i = end;
+      if (end == m) {
+        instance_totals(instance, &task->ranks, task->k, &task->answer);
+        if (forest_path != NULL && !instance_write_forest(instance, task->k)) return SOLVER_FAILED;
+        task->phase = SOLVER_PHASE_DONE;
+        return SOLVER_DONE;
+      }
+      return SOLVER_PENDING;
+
+    case SOLVER_PHASE_DONE:
+      return SOLVER_DONE;
+  }
+  return SOLVER_FAILED;
+}
+
+/**
+ * Releases the memory held by a resumable solve.
+ */
+void solver_task_free(solver_task_t *task) {
+  scan_free(&task->scanner);
+  instance_free(&task->instance);
+  island_map_free(&task->islands);
+  free(task->ranks.values);
+  free(task->buffer);
+  uf_free(task->uf);
+}
+
+// ZERO-COPY BRIDGE RECORDS
+
+/*
+ * The binary layout of an instance, as written by producers which already hold the bridges in memory. The header is
+ * followed by m packed records, whose islands are numbered from 0 and whose cost already carries BRIDGE_MARK_RED for
+ * red bridges. All the fields are in the native byte order.
+ */
+#define BRIDGE_RECORDS_MAGIC 0x33584542 // "BEX3" in little-endian.
+
+typedef struct bridge_records_header {
+  uint32_t magic;
+  uint32_t n, m;
+  uint32_t reserved;
+} bridge_records_header_t;
+
+typedef struct bridge_record {
+  uint32_t from, to;
+  uint32_t cost;
+} bridge_record_t;
+
+/**
+ * Radix sorts some bridge records without copying them first. The first pass reads the records directly and scatters
+ * them to the buffer, the second one moves them to the output.
+ *
+ * @param m the number of records.
+ * @param records the records, which are only read.
+ * @param buffer a buffer of m bridges.
+ * @param out the m sorted bridges.
+ * @return false if some record is out of range.
+ */
+bool radix_sort_records(size_t m, uint32_t n, const bridge_record_t records[m], bridge_t buffer[m], bridge_t out[m]) {
+  int frequencies[RADIX_LEVELS_MAX][RADIX_SIZE] = {0};
+  int indices[RADIX_SIZE];
+  uint32_t invalid = 0;
+  for (size_t i = 0; i < m; ++i) {
+    bridge_record_t record = records[i];
+    invalid |= record.cost & ~(uint32_t) (BRIDGE_MASK_COST | BRIDGE_MARK_RED);
+    invalid |= (record.from >= n) | (record.to >= n);
+    frequencies[0][record.cost & RADIX_MASK]++;
+    frequencies[1][(record.cost >> RADIX_BITS) & RADIX_MASK]++;
+  }
+  if (invalid) return false;
+
+  radix_compute_ends(0, frequencies, indices);
+  for (size_t i = 0; i < m; ++i) {
+    bridge_record_t record = records[i];
+    bridge_t *bridge = &buffer[--indices[record.cost & RADIX_MASK]];
+    bridge->from = (int_fast32_t) record.from;
+    bridge->to = (int_fast32_t) record.to;
+    bridge->cost = record.cost;
+    bridge->index = (uint32_t) i;
+  }
+  radix_compute_indices(1, frequencies, indices);
+  radix_scatter(0, m, 1, buffer, out, indices, false);
+  return true;
+}
+
+/**
+ * Solves an instance stored in the binary layout, directly from the memory where the producer wrote it. The records
+ * are sorted as they are read, then go through Kruskal's algorithm, or through instance_solve for the other engines.
+ *
+ * @param data the mapped instance.
+ * @param size the size of the mapping.
+ * @param answer the answer that will be returned.
+ * @return false if the data is malformed or we ran out of memory.
+ */
+bool solve_records(const void *data, size_t size, answer_t *answer) {
+  const bridge_records_header_t *header = data;
+  if (size < sizeof(bridge_records_header_t) || header->magic != BRIDGE_RECORDS_MAGIC) return false;
+  if ((size - sizeof(bridge_records_header_t)) / sizeof(bridge_record_t) < header->m) return false;
+  if (header->n >= INT32_MAX || header->m >= INT32_MAX) return false;
+  const bridge_record_t *records = (const bridge_record_t *) (header + 1);
+
+  int n = (int) header->n;
+  int m = (int) header->m;
+  bool kruskal = solver_engine == ENGINE_KRUSKAL;
+  instance_t instance = {n, m, malloc(sizeof(bridge_t) * (m + 1)), NULL, false, NULL, NULL};
+  bridge_t *buffer = malloc(sizeof(bridge_t) * (m + 1));
+  uf_item_t *uf = kruskal ? uf_alloc(n + 1) : NULL;
+  bool ok = buffer && instance.bridges && (uf || !kruskal) &&
+            radix_sort_records(m, header->n, records, buffer, instance.bridges);
+  if (ok && kruskal) {
+    uf_init(n, uf);
+    int k = kruskal_slice(uf, m, instance.bridges, m, 0, 0);
+    answer->real = false;
+    answer->result = totals(m, k, instance.bridges);
+    if (forest_path != NULL) ok = instance_write_forest(&instance, k);
+  } else if (ok) {
+    ok = instance_solve(&instance, answer);
+  }
+  free(buffer);
+  instance_free(&instance);
+  uf_free(uf);
+  return ok;
+}
+
+/**
+ * Maps a file descriptor holding an instance in the binary layout, such as a POSIX shared-memory segment or a memfd,
+ * and solves it without copying.
+ *
+ * @return false if the segment could not be mapped or solved.
+ */
+bool solve_records_fd(int fd, answer_t *answer) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) return false;
+  size_t size = (size_t) st.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) return false;
+  madvise(data, size, MADV_SEQUENTIAL);
+  bool ok = solve_records(data, size, answer);
+  munmap(data, size);
+  return ok;
+}
+
+// APACHE ARROW INPUT
+
+/*
+ * A minimal reader for Arrow IPC files, which only understands what's needed to find the from, to, cost and company
+ * columns of uncompressed record batches. The file is mapped, and the columns are read in place by the first pass of
+ * the radix sort. The metadata is stored as flatbuffers, which we decode by hand with bounds checks on every access.
+ */
+
+static inline uint16_t load_u16(const uint8_t *p) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t load_u32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t load_u64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/**
+ * A table within a flatbuffer. Positions are offsets from the start of the buffer.
+ */
+typedef struct flatbuffer {
+  const uint8_t *data;
+  size_t size;
+  size_t table;
+  size_t vtable;
+} flatbuffer_t;
+
+/**
+ * Points a flatbuffer at the table stored at the given position, checking that its vtable is within bounds.
+ */
+static bool fb_set_table(flatbuffer_t *fb, size_t table) {
+  if (table > fb->size || fb->size - table < 4) return false;
+  int64_t vtable = (int64_t) table - (int32_t) load_u32(fb->data + table);
+  if (vtable < 0 || (uint64_t) vtable > fb->size - 4) return false;
+  uint16_t vsize = load_u16(fb->data + vtable);
+  if (vsize < 4 || (uint64_t) vtable + vsize > fb->size) return false;
+  fb->table = table;
+  fb->vtable = (size_t) vtable;
+  return true;
+}
+
+/**
+ * Opens the root table of a flatbuffer.
+ */
+static bool fb_root(const uint8_t *data, size_t size, flatbuffer_t *fb) {
+  fb->data = data;
+  fb->size = size;
+  return size >= 4 && fb_set_table(fb, load_u32(data));
+}
+
+/**
+ * Finds the position of a field of the current table.
+ *
+ * @return the position of the field, or 0 if it is absent or out of bounds.
+ */
+static size_t fb_field(const flatbuffer_t *fb, int index, size_t size) {
+  size_t slot = 4 + 2 * (size_t) index;
+  if (slot + 2 > load_u16(fb->data + fb->vtable)) return 0;
+  uint16_t offset = load_u16(fb->data + fb->vtable + slot);
+  if (offset == 0) return 0;
+  size_t position = fb->table + offset;
+  if (position > fb->size || fb->size - position < size) return 0;
+  return position;
+}
+
+static int64_t fb_int(const flatbuffer_t *fb, int index, size_t size, int64_t fallback) {
+  size_t position = fb_field(fb, index, size);
+  if (position == 0) return fallback;
+  switch (size) {
+    case 1: return (int8_t) fb->data[position];
+    case 2: return (int16_t) load_u16(fb->data + position);
+    case 4: return (int32_t) load_u32(fb->data + position);
+    default: return (int64_t) load_u64(fb->data + position);
+  }
+}
+
+/**
+ * Follows the offset stored at the given position, returning the position it points to or 0 if out of bounds.
+ */
+static size_t fb_follow(const flatbuffer_t *fb, size_t position) {
+  if (position == 0 || fb->size - position < 4) return 0;
+  size_t target = position + load_u32(fb->data + position);
+  return target < fb->size ? target : 0;
+}
+
+/**
+ * Opens a sub-table of the current table.
+ */
+static bool fb_child(const flatbuffer_t *fb, int index, flatbuffer_t *child) {
+  size_t target = fb_follow(fb, fb_field(fb, index, 4));
+  *child = *fb;
+  return target != 0 && fb_set_table(child, target);
+}
+
+/**
+ * Finds a vector of the current table.
+ *
+ * @param element the size of each element.
+ * @param count the number of elements that will be returned.
+ * @return the position of the first element, or 0 if the vector is absent or out of bounds.
+ */
+static size_t fb_vector(const flatbuffer_t *fb, int index, size_t element, size_t *count) {
+  size_t vector = fb_follow(fb, fb_field(fb, index, 4));
+  if (vector == 0 || fb->size - vector < 4) return 0;
+  *count = load_u32(fb->data + vector);
+  if (*count > (fb->size - vector - 4) / element) return 0;
+  return vector + 4;
+}
+
+/**
+ * Opens the i-th table of a vector of tables.
+ */
+static bool fb_vector_child(const flatbuffer_t *fb, size_t vector, size_t i, flatbuffer_t *child) {
+  size_t target = fb_follow(fb, vector + 4 * i);
+  *child = *fb;
+  return target != 0 && fb_set_table(child, target);
+}
+
+/**
+ * Checks whether a string field of the current table is equal to the given name.
+ */
+static bool fb_string_equals(const flatbuffer_t *fb, int index, const char *name) {
+  size_t length;
+  size_t string = fb_vector(fb, index, 1, &length);
+  return string != 0 && length == strlen(name) && memcmp(fb->data + string, name, length) == 0;
+}
+
+// The identifiers of the Arrow metadata we look at, from Schema.fbs and Message.fbs.
+#define ARROW_TYPE_INT         2
+#define ARROW_TYPE_UTF8        5
+#define ARROW_MESSAGE_DICTIONARY_BATCH 2
+#define ARROW_MESSAGE_RECORD_BATCH     3
+
+/**
+ * A column of integers of any width, read in place.
+ */
+typedef struct arrow_column {
+  const uint8_t *data;
+  int width;
+  bool is_signed;
+} arrow_column_t;
+
+static inline int64_t arrow_column_get(const arrow_column_t *column, size_t i) {
+  switch (column->width) {
+    case 8: return column->is_signed ? (int8_t) column->data[i] : column->data[i];
+    case 16: {
+      uint16_t v = load_u16(column->data + 2 * i);
+      return column->is_signed ? (int16_t) v : v;
+    }
+    case 32: {
+      uint32_t v = load_u32(column->data + 4 * i);
+      return column->is_signed ? (int32_t) v : v;
+    }
+    default: return (int64_t) load_u64(column->data + 8 * i);   // 64, the only width left by arrow_read_schema.
+  }
+}
+
+/**
+ * The columns of a record batch that describe some bridges. The company is either dictionary-encoded, in which case
+ * the indices are looked up in a table of red flags built from the dictionary, or a plain string column.
+ */
+typedef struct bridge_columns {
+  size_t length;
+  arrow_column_t from, to, cost, company;
+  const uint8_t *company_red;     // The red flag of each dictionary entry, or NULL for a plain string column.
+  const uint8_t *company_chars;   // The characters of a plain string column.
+  size_t company_red_count;
+} bridge_columns_t;
+
+static inline bool bridge_columns_red(const bridge_columns_t *columns, size_t i) {
+  if (columns->company_red != NULL) {
+    int64_t index = arrow_column_get(&columns->company, i);
+    return index >= 0 && (size_t) index < columns->company_red_count && columns->company_red[index];
+  }
+  uint32_t begin = load_u32(columns->company.data + 4 * i);
+  uint32_t end = load_u32(columns->company.data + 4 * i + 4);
+  return begin < end && columns->company_chars[begin] == 'r';
+}
+
+/**
+ * What we need to know about a field of the schema.
+ */
+typedef struct arrow_field {
+  int buffer;          // The index of the first buffer of the field in a record batch.
+  int node;            // The index of the field node of the field in a record batch.
+  int type;
+  int width;
+  bool is_signed;
+  bool dictionary;
+  int64_t dictionary_id;
+} arrow_field_t;
+
+/**
+ * An Arrow IPC file, mapped in memory.
+ */
+typedef struct arrow_file {
+  const uint8_t *data;
+  size_t size;
+  arrow_field_t from, to, cost, company;
+  uint8_t *company_red;
+  size_t company_red_count;
+  bridge_columns_t *batches;
+  size_t batch_count;
+} arrow_file_t;
+
+/**
+ * Reads the integer type of a field, or of the indices of a dictionary-encoded field.
+ */
+static void arrow_read_int(const flatbuffer_t *type, arrow_field_t *field) {
+  field->width = (int) fb_int(type, 0, 4, 0);
+  field->is_signed = fb_int(type, 1, 1, 0) != 0;
+}
+
+/**
+ * Checks that a width read by arrow_read_int is one arrow_column_get can read.
+ */
+static inline bool arrow_valid_width(int width) {
+  return width == 8 || width == 16 || width == 32 || width == 64;
+}
+
+/**
+ * Reads the schema, locating the from, to, cost and company fields.
+ */
+static bool arrow_read_schema(const flatbuffer_t *schema, arrow_file_t *file) {
+  size_t count;
+  size_t fields = fb_vector(schema, 1, 4, &count);
+  if (fields == 0) return false;
+  int found = 0;
+  int buffer = 0;
+  for (size_t i = 0; i < count; ++i) {
+    flatbuffer_t field, type, dictionary, index;
+    if (!fb_vector_child(schema, fields, i, &field)) return false;
+    arrow_field_t description = {buffer, (int) i, (int) fb_int(&field, 2, 1, 0), 0, false, false, 0};
+    if (fb_child(&field, 4, &dictionary)) {
+      description.dictionary = true;
+      description.dictionary_id = fb_int(&dictionary, 0, 8, 0);
+      description.width = 32;
+      description.is_signed = true;
+      if (fb_child(&dictionary, 1, &index)) arrow_read_int(&index, &description);
+      buffer += 2;
+    } else if (description.type == ARROW_TYPE_INT) {
+      if (!fb_child(&field, 3, &type)) return false;
+      arrow_read_int(&type, &description);
+      buffer += 2;
+    } else if (description.type == ARROW_TYPE_UTF8) {
+      buffer += 3;
+    } else {
+      // Other columns would shift the buffers in ways we don't track.
+      return false;
+    }
+
+    arrow_field_t *target = NULL;
+    if (fb_string_equals(&field, 0, "from")) target = &file->from;
+    else if (fb_string_equals(&field, 0, "to")) target = &file->to;
+    else if (fb_string_equals(&field, 0, "cost")) target = &file->cost;
+    else if (fb_string_equals(&field, 0, "company")) target = &file->company;
+    if (target != NULL) {
+      *target = description;
+      ++found;
+    }
+  }
+  if (found != 4) return false;
+
+  // Check the types of the columns we use.
+  const arrow_field_t *numbers[] = {&file->from, &file->to, &file->cost};
+  for (int i = 0; i < 3; ++i) {
+    if (numbers[i]->dictionary || numbers[i]->type != ARROW_TYPE_INT) return false;
+    if (!arrow_valid_width(numbers[i]->width)) return false;
+  }
+  if (file->company.dictionary) return arrow_valid_width(file->company.width);
+  return file->company.type == ARROW_TYPE_UTF8;
+}
+
+/**
+ * Opens the message of a block of the file, returning its header and the position of its body.
+ */
+static bool arrow_read_message(const arrow_file_t *file, const flatbuffer_t *blocks, size_t i, int header_type,
+                               flatbuffer_t *header, size_t *body) {
+  const uint8_t *block = blocks->data + i * 24;
+  uint64_t offset = load_u64(block);
+  uint32_t metadata = load_u32(block + 8);
+  if (offset > file->size || file->size - offset < metadata || metadata < 8) return false;
+
+  // Skip the continuation marker, if any, and the length of the flatbuffer.
+  size_t start = (size_t) offset + 4;
+  if (load_u32(file->data + offset) == 0xFFFFFFFF) start += 4;
+  size_t length = (size_t) offset + metadata - start;
+
+  flatbuffer_t message;
+  if (!fb_root(file->data + start, length, &message)) return false;
+  if (fb_int(&message, 1, 1, 0) != header_type) return false;
+  *body = (size_t) offset + metadata;
+  return fb_child(&message, 2, header);
+}
+
+/**
+ * Finds the data of a buffer of a record batch.
+ *
+ * @param size the minimum size of the buffer.
+ * @param available the actual size of the buffer that will be returned, if not NULL.
+ * @return the data of the buffer, or NULL if out of bounds.
+ */
+static const uint8_t *arrow_buffer(const arrow_file_t *file, const flatbuffer_t *batch, size_t body, int index,
+                                   size_t size, size_t *available) {
+  size_t count;
+  size_t buffers = fb_vector(batch, 2, 16, &count);
+  if (buffers == 0 || (size_t) index >= count) return NULL;
+  uint64_t offset = load_u64(batch->data + buffers + 16 * index);
+  uint64_t length = load_u64(batch->data + buffers + 16 * index + 8);
+  if (length < size || offset > file->size - body || length > file->size - body - offset) return NULL;
+  if (available != NULL) *available = (size_t) length;
+  return file->data + body + offset;
+}
+
+/**
+ * Checks that a field of a record batch has no nulls.
+ */
+static bool arrow_no_nulls(const flatbuffer_t *batch, const arrow_field_t *field) {
+  size_t count;
+  size_t nodes = fb_vector(batch, 1, 16, &count);
+  return nodes != 0 && (size_t) field->node < count && load_u64(batch->data + nodes + 16 * field->node + 8) == 0;
+}
+
+/**
+ * Checks that the offsets of a string column are increasing and stay within its characters.
+ */
+static bool arrow_valid_offsets(const uint8_t *offsets, size_t length, size_t chars) {
+  uint32_t previous = load_u32(offsets);
+  for (size_t j = 1; j <= length; ++j) {
+    uint32_t next = load_u32(offsets + 4 * j);
+    if (next < previous) return false;
+    previous = next;
+  }
+  return previous <= chars;
+}
+
+/**
+ * Reads the dictionary of the company column, and turns it into a table of red flags.
+ */
+static bool arrow_read_dictionary(arrow_file_t *file, const flatbuffer_t *footer) {
+  flatbuffer_t blocks = *footer;
+  size_t count;
+  size_t vector = fb_vector(footer, 2, 24, &count);
+  if (vector == 0) return false;
+  blocks.data = footer->data + vector;
+  for (size_t i = 0; i < count; ++i) {
+    flatbuffer_t dictionary, batch;
+    size_t body;
+    if (!arrow_read_message(file, &blocks, i, ARROW_MESSAGE_DICTIONARY_BATCH, &dictionary, &body)) return false;
+    if (fb_int(&dictionary, 0, 8, 0) != file->company.dictionary_id) continue;
+    if (fb_int(&dictionary, 2, 1, 0) != 0 || !fb_child(&dictionary, 1, &batch)) return false;
+    if (fb_field(&batch, 3, 4) != 0) return false; // Compressed.
+
+    // Each entry takes an offset of 4 bytes in the file, which keeps 4 * (length + 1) from wrapping around.
+    int64_t entries = fb_int(&batch, 0, 8, 0);
+    if (entries < 0 || (uint64_t) entries > file->size / 4 - 1) return false;
+    size_t length = (size_t) entries;
+    size_t chars_size;
+    const uint8_t *offsets = arrow_buffer(file, &batch, body, 1, 4 * (length + 1), NULL);
+    const uint8_t *chars = arrow_buffer(file, &batch, body, 2, 0, &chars_size);
+    if (offsets == NULL || chars == NULL || !arrow_valid_offsets(offsets, length, chars_size)) return false;
+    file->company_red = malloc(length + 1);
+    if (file->company_red == NULL) return false;
+    file->company_red_count = length;
+    for (size_t j = 0; j < length; ++j) {
+      uint32_t begin = load_u32(offsets + 4 * j);
+      uint32_t end = load_u32(offsets + 4 * j + 4);
+      file->company_red[j] = begin < end && chars[begin] == 'r';
+    }
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Locates the columns of an integer field of a record batch.
+ */
+static bool arrow_read_column(const arrow_file_t *file, const flatbuffer_t *batch, size_t body,
+                              const arrow_field_t *field, size_t length, arrow_column_t *column) {
+  column->width = field->width;
+  column->is_signed = field->is_signed;
+  column->data = arrow_buffer(file, batch, body, field->buffer + 1, length * (field->width / 8), NULL);
+  return column->data != NULL && arrow_no_nulls(batch, field);
+}
+
+/**
+ * Reads an Arrow IPC file which was mapped in memory, locating the columns of all its record batches.
+ *
+ * @return false if the file is malformed or uses features we don't support.
+ */
+bool arrow_open(const uint8_t *data, size_t size, arrow_file_t *file) {
+  memset(file, 0, sizeof(arrow_file_t));
+  file->data = data;
+  file->size = size;
+  if (size < 18 || memcmp(data, "ARROW1", 6) != 0 || memcmp(data + size - 6, "ARROW1", 6) != 0) return false;
+  uint32_t footer_size = load_u32(data + size - 10);
+  if (footer_size > size - 18) return false;
+
+  flatbuffer_t footer, schema;
+  if (!fb_root(data + size - 10 - footer_size, footer_size, &footer)) return false;
+  if (!fb_child(&footer, 1, &schema) || !arrow_read_schema(&schema, file)) return false;
+  if (file->company.dictionary && !arrow_read_dictionary(file, &footer)) return false;
+
+  size_t count;
+  size_t vector = fb_vector(&footer, 3, 24, &count);
+  if (vector == 0) return false;
+  flatbuffer_t blocks = footer;
+  blocks.data = footer.data + vector;
+  file->batches = calloc(count + 1, sizeof(bridge_columns_t));
+  if (file->batches == NULL) return false;
+  file->batch_count = count;
+
+  for (size_t i = 0; i < count; ++i) {
+    flatbuffer_t batch;
+    size_t body;
+    bridge_columns_t *columns = &file->batches[i];
+    if (!arrow_read_message(file, &blocks, i, ARROW_MESSAGE_RECORD_BATCH, &batch, &body)) return false;
+    if (fb_field(&batch, 3, 4) != 0) return false; // Compressed.
+    int64_t length = fb_int(&batch, 0, 8, 0);
+    if (length < 0 || (uint64_t) length > size) return false;
+    columns->length = (size_t) length;
+    if (!arrow_read_column(file, &batch, body, &file->from, columns->length, &columns->from)) return false;
+    if (!arrow_read_column(file, &batch, body, &file->to, columns->length, &columns->to)) return false;
+    if (!arrow_read_column(file, &batch, body, &file->cost, columns->length, &columns->cost)) return false;
+    if (file->company.dictionary) {
+      if (!arrow_read_column(file, &batch, body, &file->company, columns->length, &columns->company)) return false;
+      columns->company_red = file->company_red;
+      columns->company_red_count = file->company_red_count;
+    } else {
+      size_t chars_size;
+      int buffer = file->company.buffer;
+      columns->company.data = arrow_buffer(file, &batch, body, buffer + 1, 4 * (columns->length + 1), NULL);
+      columns->company_chars = arrow_buffer(file, &batch, body, buffer + 2, 0, &chars_size);
+      if (columns->company.data == NULL || columns->company_chars == NULL) return false;
+      if (!arrow_valid_offsets(columns->company.data, columns->length, chars_size)) return false;
+      if (!arrow_no_nulls(&batch, &file->company)) return false;
+    }
+  }
+  return true;
+}
+
+void arrow_close(arrow_file_t *file) {
+  free(file->company_red);
+  free(file->batches);
+}
+
+/**
+ * Solves the bridges of a set of record batches. The first radix pass reads the columns in place and scatters them
+ * to a buffer of bridges. Costs which don't fit in BRIDGE_MASK_COST, or an engine other than Kruskal's, fall back to
+ * solving an instance built from the columns. Islands are numbered up to INT32_MAX - 1, so n + 1 still fits in an int.
+ *
+ * @return false if some island is out of range or we ran out of memory.
+ */
+bool solve_columns(size_t count, const bridge_columns_t batches[count], answer_t *answer) {
+  int frequencies[RADIX_LEVELS_MAX][RADIX_SIZE] = {0};
+  int indices[RADIX_SIZE];
+  int64_t n = 0;
+  size_t m = 0;
+  bool wide = false;
+
+  for (size_t b = 0; b < count; ++b) {
+    const bridge_columns_t *columns = &batches[b];
+    for (size_t i = 0; i < columns->length; ++i) {
+      int64_t from = arrow_column_get(&columns->from, i);
+      int64_t to = arrow_column_get(&columns->to, i);
+      int64_t cost = arrow_column_get(&columns->cost, i);
+      if (from < 1 || to < 1 || from >= INT32_MAX || to >= INT32_MAX) return false;
+      if (from > n) n = from;
+      if (to > n) n = to;
+      wide |= cost < 0 || cost > BRIDGE_MASK_COST;
+      uint_fast32_t key = (uint_fast32_t) cost | (bridge_columns_red(columns, i) ? BRIDGE_MARK_RED : 0);
+      frequencies[0][key & RADIX_MASK]++;
+      frequencies[1][(key >> RADIX_BITS) & RADIX_MASK]++;
+    }
+    m += columns->length;
+  }
+  if (m >= INT32_MAX) return false;
+
+  bool fused = !wide && solver_engine == ENGINE_KRUSKAL;
+  instance_t instance = {(int) n, (int) m, malloc(sizeof(bridge_t) * (m + 1)), NULL, false, NULL, NULL};
+  bridge_t *buffer = fused ? malloc(sizeof(bridge_t) * (m + 1)) : NULL;
+  uf_item_t *uf = fused ? uf_alloc(n + 1) : NULL;
+  bool ok = instance.bridges != NULL && (!fused || (buffer != NULL && uf != NULL));
+
+  if (ok && !fused) {
+    // Build the instance from the columns, and let it go through the engine and the rank-space compression.
+    if (wide) {
+      instance.wide = malloc(sizeof(uint64_t) * (m + 1));
+      ok = instance.wide != NULL;
+    }
+    for (size_t b = 0, j = 0; ok && b < count; ++b) {
+      const bridge_columns_t *columns = &batches[b];
+      for (size_t i = 0; i < columns->length; ++i, ++j) {
+        int64_t cost = arrow_column_get(&columns->cost, i);
+        instance.bridges[j].from = (int_fast32_t) arrow_column_get(&columns->from, i) - 1;
+        instance.bridges[j].to = (int_fast32_t) arrow_column_get(&columns->to, i) - 1;
+        uint_fast32_t red = bridge_columns_red(columns, i) ? BRIDGE_MARK_RED : 0;
+        instance.bridges[j].cost = (wide ? 0 : (uint_fast32_t) cost) | red;
+        instance.bridges[j].index = (uint32_t) j;
+        if (wide) instance.wide[j] = ranks_key_of_long(cost);
+      }
+    }
+    ok = ok && instance_solve(&instance, answer);
+  } else if (ok) {
+    radix_compute_ends(0, frequencies, indices);
+    for (size_t b = 0, j = 0; b < count; ++b) {
+      const bridge_columns_t *columns = &batches[b];
+      for (size_t i = 0; i < columns->length; ++i, ++j) {
+        uint_fast32_t key =
+            (uint_fast32_t) arrow_column_get(&columns->cost, i) | (bridge_columns_red(columns, i) ? BRIDGE_MARK_RED : 0);
+        bridge_t *bridge = &buffer[--indices[key & RADIX_MASK]];
+        bridge->from = (int_fast32_t) arrow_column_get(&columns->from, i) - 1;
+        bridge->to = (int_fast32_t) arrow_column_get(&columns->to, i) - 1;
+        bridge->cost = key;
+        bridge->index = (uint32_t) j;
+      }
+    }
+    radix_compute_indices(1, frequencies, indices);
+    radix_scatter(0, m, 1, buffer, instance.bridges, indices, false);
+    uf_init(instance.n, uf);
+    int k = kruskal_slice(uf, instance.m, instance.bridges, instance.m, 0, 0);
+    answer->real = false;
+    answer->result = totals(instance.m, k, instance.bridges);
+    if (forest_path != NULL) ok = instance_write_forest(&instance, k);
+  }
+
+  free(buffer);
+  uf_free(uf);
+  instance_free(&instance);
+  return ok;
+}
+
+/**
+ * Maps an Arrow IPC file and solves the bridges of all its record batches.
+ *
+ * @return false if the file could not be read or solved.
+ */
+bool solve_arrow_file(const char *path, answer_t *answer) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+  void *data = ok ? mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED) return false;
+
+  arrow_file_t file;
+  ok = arrow_open(data, (size_t) st.st_size, &file) && solve_columns(file.batch_count, file.batches, answer);
+  arrow_close(&file);
+  munmap(data, (size_t) st.st_size);
+  return ok;
+}
+
+// DELTA INSTANCES
+
+/*
+ * A delta instance describes a network which only differs slightly from a base instance:
+ *
+ *   delta <path of the base instance> <number of changes>
+ *   + <from> <to> <cost> <company>     (a bridge added to the base)
+ *   - <from> <to> <cost> <company>     (a bridge removed from the base)
+ *
+ * A changed bridge is removed, then added again, and removing a bridge added earlier in the same delta cancels that
+ * addition. Each base is parsed, sorted and solved once, and shared by all the deltas which refer to it, even across
+ * the threads of a batch.
+ *
+ * By the cycle property, a bridge which isn't in the forest of the base can't come back in the forest unless a forest
+ * bridge is removed. So as long as only non-forest bridges are removed, the answer is the one of the base forest plus
+ * the added bridges, which only takes time linear in n and the size of the delta. When a forest bridge is removed, the
+ * replacement may be any bridge of the base, but the rest of the base forest is still a forest of the new network: a
+ * base bridge whose islands it still connects is the cheapest of a cycle, and so is an added bridge cheaper than the
+ * whole path between its islands. Only the other bridges are merged, still without sorting the base again. Deltas only
+ * support costs which fit in BRIDGE_MASK_COST.
+ */
+
+#define DELTA_PATH_MAX 4096
+
+/**
+ * An open-addressing multiset of bridges, where a bridge is identified by its islands (in any order) and its key.
+ */
+typedef struct bridge_set {
+  size_t capacity;
+  bridge_t *bridges;
+  int *counts;
+} bridge_set_t;
+
+static inline uint64_t bridge_set_hash(bridge_t bridge) {
+  uint64_t lo = (uint64_t) (bridge.from < bridge.to ? bridge.from : bridge.to);
+  uint64_t hi = (uint64_t) (bridge.from < bridge.to ? bridge.to : bridge.from);
+  uint64_t h = (lo << 32 | hi) * UINT64_C(0x9E3779B97F4A7C15);
+  return (h ^ (h >> 29) ^ bridge.cost) * UINT64_C(0xBF58476D1CE4E5B9);
+}
+
+static inline bool bridge_same(bridge_t a, bridge_t b) {
+  return a.cost == b.cost && ((a.from == b.from && a.to == b.to) || (a.from == b.to && a.to == b.from));
+}
+
+bool bridge_set_init(bridge_set_t *set, size_t count) {
+  set->capacity = 4;
+  while (set->capacity < 2 * count) set->capacity <<= 1;
+  set->bridges = malloc(sizeof(bridge_t) * set->capacity);
+  set->counts = calloc(set->capacity, sizeof(int));
+  return set->bridges != NULL && set->counts != NULL;
+}
+
+/**
+ * Finds the slot of a bridge, which is either the slot holding it or the empty slot where it would go.
+ */
+static size_t bridge_set_slot(const bridge_set_t *set, bridge_t bridge) {
+  size_t slot = bridge_set_hash(bridge) >> 32 & (set->capacity - 1);
+  while (set->counts[slot] != 0 && !bridge_same(set->bridges[slot], bridge)) slot = (slot + 1) & (set->capacity - 1);
+  return slot;
+}
+
+void bridge_set_add(bridge_set_t *set, bridge_t bridge) {
+  size_t slot = bridge_set_slot(set, bridge);
+  set->bridges[slot] = bridge;
+  set->counts[slot]++;
+}
+
+bool bridge_set_contains(const bridge_set_t *set, bridge_t bridge) {
+  return set->counts[bridge_set_slot(set, bridge)] > 0;
+}
+
+/**
+ * Removes one occurrence of a bridge. Emptied slots keep their bridge, so probing sequences stay intact.
+ *
+ * @return true if the bridge was in the set.
+ */
+bool bridge_set_take(bridge_set_t *set, bridge_t bridge) {
+  size_t slot = bridge_set_slot(set, bridge);
+  if (set->counts[slot] <= 0) return false;
+  // Keep a tombstone with a negative count, so the slot isn't considered empty.
+  set->counts[slot] = set->counts[slot] == 1 ? -1 : set->counts[slot] - 1;
+  return true;
+}
+
+void bridge_set_free(bridge_set_t *set) {
+  free(set->bridges);
+  free(set->counts);
+}
+
+/**
+ * A base instance, sorted and solved once.
+ */
+typedef struct base {
+  int n, m, k;
+  bridge_t *sorted;       // All the bridges, by increasing cost.
+  bridge_t *forest;       // The k bridges of the forest, by increasing cost.
+  bridge_set_t in_forest;
+} base_t;
+
+/**
+ * Runs Kruskal's algorithm over the merge of two sequences of bridges sorted by increasing cost, from the most
+ * expensive bridge down. Bridges of the first sequence found in the removed set are skipped, once per occurrence.
+ *
+ * @return the answer for the selected bridges.
+ */
+static result_t kruskal_merge(uf_item_t *uf, int na, const bridge_t a[na], int nb, const bridge_t b[nb],
+                              bridge_set_t *removed) {
+  result_t result = {0, 0};
+  int i = na - 1, j = nb - 1;
+  while (i >= 0 || j >= 0) {
+    bridge_t bridge;
+    if (j < 0 || (i >= 0 && a[i].cost >= b[j].cost)) {
+      bridge = a[i--];
+      if (removed != NULL && bridge_set_take(removed, bridge)) continue;
+    } else {
+      bridge = b[j--];
+    }
+    int fr = uf_find(uf, bridge.from);
+    int tr = uf_find(uf, bridge.to);
+    if (fr != tr) {
+      uf_union_r(uf, fr, tr);
+      if ((bridge.cost & BRIDGE_MARK_RED) == BRIDGE_MARK_RED) {
+        result.red += bridge.cost & BRIDGE_MASK_COST;
+      } else {
+        result.blue += bridge.cost;
+      }
+    }
+  }
+  return result;
+}
+
+/**
+ * Parses, sorts and solves a base instance.
+ *
+ * @return the base, or NULL if it could not be read, uses wide costs, or we ran out of memory.
+ */
+base_t *base_load(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) return NULL;
+  scanner_t scanner;
+  instance_t instance = {0, 0, NULL, NULL, false, NULL, NULL};
+  base_t *base = calloc(1, sizeof(base_t));
+  bool ok = base != NULL && scan_init(&scanner, file) && instance_init(&instance, &scanner, NULL) &&
+            instance_parse(&instance, &scanner, 0, instance.m) && instance.wide == NULL;
+  if (base != NULL) scan_free(&scanner);
+  fclose(file);
+
+  uf_item_t *uf = NULL;
+  if (ok) {
+    base->n = instance.n;
+    base->m = instance.m;
+    base->sorted = instance.bridges;
+    instance.bridges = NULL;
+    base->forest = malloc(sizeof(bridge_t) * (base->n + 1));
+    uf = uf_alloc(base->n + 1);
+    ok = base->forest != NULL && uf != NULL && radix_sort_increasing(base->m, base->sorted) &&
+         bridge_set_init(&base->in_forest, base->n);
+  }
+  if (ok) {
+    // Pick the forest without moving the sorted bridges, and store it by increasing cost.
+    uf_init(base->n, uf);
+    for (int i = base->m - 1; i >= 0; --i) {
+      bridge_t bridge = base->sorted[i];
+      int fr = uf_find(uf, bridge.from);
+      int tr = uf_find(uf, bridge.to);
+      if (fr != tr) {
+        uf_union_r(uf, fr, tr);
+        base->forest[base->n - 1 - base->k++] = bridge;
+      }
+    }
+    memmove(base->forest, base->forest + base->n - base->k, sizeof(bridge_t) * base->k);
+    for (int i = 0; i < base->k; ++i) bridge_set_add(&base->in_forest, base->forest[i]);
+  }
+  uf_free(uf);
+  instance_free(&instance);
+  if (!ok && base != NULL) {
+    free(base->sorted);
+    free(base->forest);
+    free(base);
+    base = NULL;
+  }
+  return base;
+}
+
+/**
+ * The bases loaded so far, shared by all the threads.
+ */
+typedef struct base_entry {
+  char *path;
+  base_t *base;
+  bool loading;
+  struct base_entry *next;
+} base_entry_t;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t loaded;
+  base_entry_t *entries;
+} base_cache = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL};
+
+/**
+ * Finds the base with the given path, loading it if no other delta did so yet. Concurrent deltas referring to a base
+ * being loaded wait for it.
+ *
+ * @return the base, or NULL if it could not be loaded.
+ */
+const base_t *base_get(const char *path) {
+  pthread_mutex_lock(&base_cache.lock);
+  base_entry_t *entry = base_cache.entries;
+  while (entry != NULL && strcmp(entry->path, path) != 0) entry = entry->next;
+  if (entry == NULL) {
+    entry = calloc(1, sizeof(base_entry_t));
+    if (entry == NULL || (entry->path = strdup(path)) == NULL) {
+      free(entry);
+      pthread_mutex_unlock(&base_cache.lock);
+      return NULL;
+    }
+    entry->loading = true;
+    entry->next = base_cache.entries;
+    base_cache.entries = entry;
+    pthread_mutex_unlock(&base_cache.lock);
+
+    base_t *base = base_load(path);
+
+    pthread_mutex_lock(&base_cache.lock);
+    entry->base = base;
+    entry->loading = false;
+    pthread_cond_broadcast(&base_cache.loaded);
+  }
+  while (entry->loading) pthread_cond_wait(&base_cache.loaded, &base_cache.lock);
+  pthread_mutex_unlock(&base_cache.lock);
+  return entry->base;
+}
+
+void base_cache_free(void) {
+  for (base_entry_t *entry = base_cache.entries, *next; entry != NULL; entry = next) {
+    next = entry->next;
+    if (entry->base != NULL) {
+      free(entry->base->sorted);
+      free(entry->base->forest);
+      bridge_set_free(&entry->base->in_forest);
+      free(entry->base);
+    }
+    free(entry->path);
+    free(entry);
+  }
+  base_cache.entries = NULL;
+}
+
+/**
+ * Keeps the bridges which can still be in the forest of a delta which removes some bridges of the base forest: the
+ * forest bridges which aren't removed, the base bridges whose islands they don't connect, and the added bridges which
+ * aren't cheaper than the whole path between their islands. The kept bridges stay in increasing order.
+ *
+ * @param kept set to the number of kept base bridges, which are stored in candidates.
+ * @param additions the number of added bridges, updated to the number of kept ones.
+ * @return false if we ran out of memory.
+ */
+static bool delta_filter(const base_t *base, const bridge_set_t *removed, uf_item_t *uf, arena_t *arena,
+                         bridge_t candidates[], int *kept, bridge_t added[], int *additions) {
+  bridge_t *remaining = arena_alloc(arena, sizeof(bridge_t) * (base->k + 1));
+  int *label = arena_alloc(arena, sizeof(int) * (base->n + 1));
+  bool *keep = arena_alloc(arena, sizeof(bool) * (*additions + 1));
+  if (remaining == NULL || label == NULL || keep == NULL) return false;
+
+  // A forest bridge with removed copies is left out of the remaining forest, which only keeps more candidates.
+  int k = 0;
+  uf_init(base->n, uf);
+  for (int i = 0; i < base->k; ++i) {
+    bridge_t bridge = base->forest[i];
+    if (bridge_set_contains(removed, bridge)) continue;
+    uf_union_r(uf, uf_find(uf, bridge.from), uf_find(uf, bridge.to));
+    remaining[k++] = bridge;
+  }
+  for (int u = 0; u < base->n; ++u) label[u] = uf_find(uf, u);
+
+  *kept = 0;
+  for (int i = 0; i < base->m; ++i) {
+    bridge_t bridge = base->sorted[i];
+    if (label[bridge.from] != label[bridge.to] ||
+        (bridge_set_contains(&base->in_forest, bridge) && !bridge_set_contains(removed, bridge))) {
+      candidates[(*kept)++] = bridge;
+    }
+  }
+
+  if (forest_filter(base->n, k, remaining, *additions, added, keep) < 0) return false;
+  int light = 0;
+  for (int i = 0; i < *additions; ++i) {
+    if (keep[i]) added[light++] = added[i];
+  }
+  *additions = light;
+  return true;
+}
+
+/**
+ * Parses and solves a delta instance, whose "delta" keyword is next in the scanner.
+ *
+ * @return false if the delta or its base could not be read, or we ran out of memory.
+ */
+bool delta_solve(scanner_t *s, arena_t *arena, answer_t *answer) {
+  char word[DELTA_PATH_MAX];
+  scan_reserve(s);
+  scan_word(s, word, sizeof(word));
+  if (scan_word(s, word, sizeof(word)) == 0) return false;
+  const base_t *base = base_get(word);
+  if (base == NULL) return false;
+  int changes = scan_int(s);
+  if (changes < 0) return false;
+
+  bridge_t *added = arena_alloc(arena, sizeof(bridge_t) * (changes + 1));
+  bridge_t *buffer = arena_alloc(arena, sizeof(bridge_t) * (changes + 1));
+  uf_item_t *uf = arena_alloc(arena, sizeof(uf_item_t) * (base->n + 1));
+  bridge_set_t removed, pending, cancelled;
+  if (added == NULL || buffer == NULL || uf == NULL) return false;
+  bool ok = bridge_set_init(&removed, changes) & bridge_set_init(&pending, changes) &
+            bridge_set_init(&cancelled, changes);
+
+  // Parse the changes, checking whether some bridge of the forest goes away. A removal cancels a previous addition of
+  // the same bridge, if there is one.
+  int additions = 0;
+  bool forest_changed = false;
+  for (int i = 0; i < changes && ok; ++i) {
+    scan_reserve(s);
+    char op[2];
+    scan_word(s, op, sizeof(op));
+    bridge_t bridge;
+    bridge.from = scan_int(s) - 1;
+    bridge.to = scan_int(s) - 1;
+    bridge.cost = (uint_fast32_t) scan_int(s);
+    bridge.index = (uint32_t) (base->m + i);
+    ok = bridge.cost <= BRIDGE_MASK_COST && bridge.from >= 0 && bridge.to >= 0 && bridge.from < base->n &&
+         bridge.to < base->n && (op[0] == '+' || op[0] == '-');
+    bridge.cost |= scan_company(s);
+    if (op[0] == '+') {
+      added[additions++] = bridge;
+      bridge_set_add(&pending, bridge);
+    } else if (bridge_set_take(&pending, bridge)) {
+      bridge_set_add(&cancelled, bridge);
+    } else {
+      forest_changed |= bridge_set_contains(&base->in_forest, bridge);
+      bridge_set_add(&removed, bridge);
+    }
+  }
+
+  if (ok) {
+    int kept = 0;
+    for (int i = 0; i < additions; ++i) {
+      if (!bridge_set_take(&cancelled, added[i])) added[kept++] = added[i];
+    }
+    radix_sort_increasing_buffer(kept, RADIX_LEVELS, added, buffer);
+    uf_init(base->n, uf);
+    answer->real = false;
+    if (forest_changed) {
+      bridge_t *candidates = arena_alloc(arena, sizeof(bridge_t) * (base->m + 1));
+      int count = 0;
+      ok = candidates != NULL && delta_filter(base, &removed, uf, arena, candidates, &count, added, &kept);
+      uf_init(base->n, uf);
+      if (ok) answer->result = kruskal_merge(uf, count, candidates, kept, added, &removed);
+    } else {
+      answer->result = kruskal_merge(uf, base->k, base->forest, kept, added, NULL);
+    }
+  }
+  bridge_set_free(&pending);
+  bridge_set_free(&cancelled);
+  bridge_set_free(&removed);
+  return ok;
+}
+
+// RESULT CACHE
+
+/*
+ * The answers can be kept in a directory, one file per input named after the hash of its bytes and the kind of island
+ * identifiers, so an input which has already been solved is answered without solving it again. A hit refreshes the
+ * modification time of its file, and once the files take more than result_cache_size, those used least recently are
+ * removed until they take three quarters of it. Files are written under a hidden name then renamed, so concurrent
+ * solves never read a partial file.
+ *
+ * The directory is only listed by the first store and by those which take the cache beyond its size. The others add
+ * the size of their file to a running total, so a batch doesn't read the whole directory for each of its inputs.
+ *
+ * Delta instances are not cached, as their answer also depends on the file of their base.
+ */
+
+// The directory of the result cache, or NULL if there's none.
+const char *result_cache_dir = NULL;
+
+// The size the files of the cache may take on disk before some get evicted.
+size_t result_cache_size = 16 * 1024 * 1024;
+
+static pthread_mutex_t result_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint result_cache_writes = 0;
+static size_t result_cache_used = 0;         // The size of the files as last listed, plus those stored since.
+static bool result_cache_listed = false;     // Whether the directory was listed once, so result_cache_used is set.
+
+/**
+ * The content of a file of the cache.
+ */
+typedef struct result_cache_entry {
+  uint64_t hash;
+  uint64_t bytes;      // The length of the input, checked as well in case of a collision.
+  answer_t answer;
+} result_cache_entry_t;
+
+/**
+ * A file of the cache, while looking for those to evict.
+ */
+typedef struct result_cache_file {
+  char *name;
+  struct timespec used;
+  size_t size;
+} result_cache_file_t;
+
+static void result_cache_path(char *path, size_t size, const scanner_t *s) {
+  snprintf(path, size, "%s/%016llx.%d", result_cache_dir, (unsigned long long) hash_digest(&s->hash), (int) island_ids);
+}
+
+/**
+ * Looks for the answer to the input read by a scanner, which must have been read until its end.
+ *
+ * @return true if the answer was found.
+ */
+bool result_cache_lookup(const scanner_t *s, answer_t *answer) {
+  char path[PATH_MAX];
+  result_cache_path(path, sizeof(path), s);
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) return false;
+  result_cache_entry_t entry;
+  bool found = fread(&entry, sizeof(entry), 1, file) == 1 && entry.hash == hash_digest(&s->hash) &&
+               entry.bytes == s->bytes;
+  fclose(file);
+  if (found) {
+    *answer = entry.answer;
+    utimensat(AT_FDCWD, path, NULL, 0);
+  }
+  return found;
+}
+
+static int result_cache_file_compare(const void *a, const void *b) {
+  const struct timespec *x = &((const result_cache_file_t *) a)->used;
+  const struct timespec *y = &((const result_cache_file_t *) b)->used;
+  if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+  return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+/**
+ * Lists the files of the cache to count their size, and removes those used least recently if they don't fit in
+ * result_cache_size, down to three quarters of it. The caller holds result_cache_lock.
+ */
+static void result_cache_evict(void) {
+  DIR *directory = opendir(result_cache_dir);
+  result_cache_file_t *files = NULL;
+  size_t count = 0, capacity = 0, total = 0;
+  struct dirent *entry;
+  while (directory != NULL && (entry = readdir(directory)) != NULL) {
+    struct stat st;
+    if (entry->d_name[0] == '.' || fstatat(dirfd(directory), entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    if (count == capacity) {
+      capacity = capacity == 0 ? 64 : 2 * capacity;
+      result_cache_file_t *grown = realloc(files, sizeof(result_cache_file_t) * capacity);
+      if (grown == NULL) break;
+      files = grown;
+    }
+    files[count].name = strdup(entry->d_name);
+    if (files[count].name == NULL) break;
+    files[count].used = st.st_mtim;
+    files[count].size = (size_t) st.st_blocks * 512;
+    total += files[count++].size;
+  }
+  if (total > result_cache_size) {
+    size_t target = result_cache_size - result_cache_size / 4;
+    qsort(files, count, sizeof(result_cache_file_t), result_cache_file_compare);
+    for (size_t i = 0; i < count && total > target; ++i) {
+      if (unlinkat(dirfd(directory), files[i].name, 0) == 0) total -= files[i].size;
+    }
+  }
+  result_cache_used = total;
+  result_cache_listed = true;
+  for (size_t i = 0; i < count; ++i) free(files[i].name);
+  free(files);
+  if (directory != NULL) closedir(directory);
+}
+
+/**
+ * Remembers the answer to the input read by a scanner, which must have been read until its end. Failures are ignored,
+ * the answer just won't be found next time.
+ */
+void result_cache_store(const scanner_t *s, const answer_t *answer) {
+  result_cache_entry_t entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.hash = hash_digest(&s->hash);
+  entry.bytes = s->bytes;
+  entry.answer = *answer;
+
+  char path[PATH_MAX], temporary[PATH_MAX];
+  result_cache_path(path, sizeof(path), s);
+  snprintf(temporary, sizeof(temporary), "%s/.%016llx.%ld.%u", result_cache_dir, (unsigned long long) entry.hash,
+           (long) getpid(), atomic_fetch_add(&result_cache_writes, 1));
+  FILE *file = fopen(temporary, "wb");
+  if (file == NULL) return;
+  bool ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+  ok &= fclose(file) == 0;
+  struct stat st;
+  ok = ok && stat(temporary, &st) == 0;
+  if (!ok || rename(temporary, path) != 0) {
+    unlink(temporary);
+    return;
+  }
+
+  // A file replacing another one is counted twice, which only makes the next listing come a bit earlier.
+  pthread_mutex_lock(&result_cache_lock);
+  result_cache_used += (size_t) st.st_blocks * 512;
+  if (!result_cache_listed || result_cache_used > result_cache_size) result_cache_evict();
+  pthread_mutex_unlock(&result_cache_lock);
+}
+
+// BATCHES
+
+/**
+ * Solves the instance or the delta instance read by a scanner.
+ *
+ * @param arena the arena to allocate from, which gets reset once the instance is solved.
+ * @return false if the instance could not be read, a forest is asked of a delta instance, or we ran out of memory.
+ */
+bool solve_scanner(scanner_t *s, arena_t *arena, answer_t *answer) {
+  bool ok;
+  if (scan_peek(s, "delta")) {
+    ok = forest_path == NULL && delta_solve(s, arena, answer);
+  } else if (s->hashing && forest_path == NULL && s->eof && result_cache_lookup(s, answer)) {
+    // The whole input was read at once, so a cached answer is found before parsing anything.
+    ok = true;
+  } else {
+    instance_t instance = {0, 0, NULL, NULL, false, NULL, NULL};
+    island_map_t islands = {0};
+    ok = instance_init(&instance, s, arena) && instance_map_islands(&instance, &islands) &&
+         instance_parse(&instance, s, 0, instance.m);
+    bool caching = s->hashing && forest_path == NULL;
+    if (ok && caching) scan_drain(s);
+    bool cached = ok && caching && result_cache_lookup(s, answer);
+    if (ok && !cached) ok = instance_solve(&instance, answer);
+    if (ok && !cached && caching) result_cache_store(s, answer);
+    free(instance.wide);
+    island_map_free(&islands);
+  }
+  arena_reset(arena);
+  return ok;
+}
+
+/**
+ * A batch of instance files, solved concurrently. Each worker solves one file at a time with its own scanner and
+ * arena. The answers go through a reorder buffer: each one is printed as soon as those of all the paths before it
+ * have been, while the later files are still being solved.
+ *
+ * The buffer has a slot per file in flight, for a window of BATCH_WINDOW files per thread after the first one which
+ * isn't printed yet. A worker waits before starting a file beyond the window, so a slow file holds back a bounded
+ * number of answers.
+ */
+
+#define BATCH_WINDOW 4   // The number of files each thread may have in flight.
+
+typedef struct batch {
+  char **paths;
+  size_t count;
+  size_t window;          // The number of slots of the reorder buffer.
+  answer_t *answers;      // The answer of the path at index i, in slot i % window.
+  bool *solved;
+  bool *done;             // Whether the slot holds the answer of a path which isn't printed yet.
+  size_t printed;         // The number of paths printed so far.
+  bool ok;                // Whether all the paths printed so far were solved.
+  pthread_mutex_t lock;
+  pthread_cond_t room;    // Signaled when printed goes up.
+  arena_t *arenas;        // One arena per thread, reused from one instance to the next.
+  pthread_key_t arena;    // The arena of the current thread.
+  atomic_int next_arena;
+} batch_t;
+
+/**
+ * Solves an instance file.
+ *
+ * @return false if the file could not be read or we ran out of memory.
+ */
+bool solve_file(const char *path, arena_t *arena, answer_t *answer) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) return false;
+  scanner_t scanner;
+  bool ok = scan_init(&scanner, file) && solve_scanner(&scanner, arena, answer);
+  scan_free(&scanner);
+  fclose(file);
+  return ok;
+}
+
+static void batch_job(void *context, size_t i) {
+  batch_t *batch = context;
+  arena_t *arena = pthread_getspecific(batch->arena);
+  if (arena == NULL) {
+    arena = &batch->arenas[atomic_fetch_add(&batch->next_arena, 1)];
+    pthread_setspecific(batch->arena, arena);
+  }
+
+  pthread_mutex_lock(&batch->lock);
+  while (i >= batch->printed + batch->window) pthread_cond_wait(&batch->room, &batch->lock);
+  pthread_mutex_unlock(&batch->lock);
+
+  // The slot is free: the path which used it last is printed, and no other path in the window maps to it.
+  size_t slot = i % batch->window;
+  batch->solved[slot] = solve_file(batch->paths[i], arena, &batch->answers[slot]);
+
+  pthread_mutex_lock(&batch->lock);
+  batch->done[slot] = true;
+  size_t printed = batch->printed;
+  while (batch->printed < batch->count && batch->done[batch->printed % batch->window]) {
+    size_t next = batch->printed % batch->window;
+    if (batch->solved[next]) {
+      answer_print(&batch->answers[next], stdout);
+    } else {
+      fprintf(stderr, "Could not solve %s.\n", batch->paths[batch->printed]);
+      fputc('\n', stdout);
+      batch->ok = false;
+    }
+    batch->done[next] = false;
+    batch->printed++;
+  }
+  if (batch->printed > printed) {
+    fflush(stdout);
+    pthread_cond_broadcast(&batch->room);
+  }
+  pthread_mutex_unlock(&batch->lock);
+}
+
+/**
+ * Solves a batch of instance files on a pool, printing one line per file in the order of the paths as soon as it can. A
+ * file which could not be solved gets an empty line, and an error on stderr.
+ *
+ * @return false if some file could not be solved.
+ */
+bool batch_solve(pool_t *pool, size_t count, char *paths[count]) {
+  batch_t batch;
+  batch.paths = paths;
+  batch.count = count;
+  batch.window = (size_t) pool->threads * BATCH_WINDOW;
+  batch.answers = malloc(sizeof(answer_t) * batch.window);
+  batch.solved = calloc(batch.window, sizeof(bool));
+  batch.done = calloc(batch.window, sizeof(bool));
+  batch.printed = 0;
+  batch.ok = true;
+  batch.arenas = malloc(sizeof(arena_t) * pool->threads);
+  atomic_init(&batch.next_arena, 0);
+  if (batch.answers == NULL || batch.solved == NULL || batch.done == NULL || batch.arenas == NULL ||
+      pthread_key_create(&batch.arena, NULL) != 0) {
+    fprintf(stderr, "Not enough memory to solve the batch.\n");
+    return false;
+  }
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.room, NULL);
+  for (int t = 0; t < pool->threads; ++t) arena_init(&batch.arenas[t]);
+
+  pool_run(pool, count, batch_job, &batch);
+
+  pthread_key_delete(batch.arena);
+  pthread_mutex_destroy(&batch.lock);
+  pthread_cond_destroy(&batch.room);
+  for (int t = 0; t < pool->threads; ++t) arena_free(&batch.arenas[t]);
+  free(batch.arenas);
+  free(batch.answers);
+  free(batch.solved);
+  free(batch.done);
+  return batch.ok;
+}
+
+/**
+ * A list of paths, which grows as paths are added.
+ */
+typedef struct path_list {
+  char **paths;
+  size_t count, capacity;
+} path_list_t;
+
+static bool path_list_add(path_list_t *list, char *path) {
+  if (list->count == list->capacity) {
+    size_t capacity = list->capacity == 0 ? 16 : 2 * list->capacity;
+    char **paths = realloc(list->paths, sizeof(char *) * capacity);
+    if (paths == NULL) return false;
+    list->paths = paths;
+    list->capacity = capacity;
+  }
+  list->paths[list->count++] = path;
+  return true;
+}
+
+static int path_compare(const void *a, const void *b) {
+  return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+// The pattern which the names of the files of a directory must match to be solved, or NULL to solve all of them.
+const char *path_pattern = NULL;
+
+/**
+ * Checks whether a file of a directory should be solved. Hidden files are skipped, and the others must match
+ * path_pattern if there is one.
+ */
+static bool path_is_instance(const char *name) {
+  return name[0] != '.' && (path_pattern == NULL || fnmatch(path_pattern, name, 0) == 0);
+}
+
+/**
+ * Adds a path to the list, expanding directories to the files they contain which path_is_instance keeps, sorted by
+ * name.
+ *
+ * @return false if the directory could not be read or we ran out of memory.
+ */
+bool path_list_expand(path_list_t *list, const char *path) {
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    char *copy = strdup(path);
+    return copy != NULL && path_list_add(list, copy);
+  }
+  DIR *directory = opendir(path);
+  if (directory == NULL) return false;
+  size_t first = list->count;
+  bool ok = true;
+  struct dirent *entry;
+  while (ok && (entry = readdir(directory)) != NULL) {
+    if (!path_is_instance(entry->d_name)) continue;
+    size_t length = strlen(path) + strlen(entry->d_name) + 2;
+    char *child = malloc(length);
+    ok = child != NULL;
+    if (ok) {
+      snprintf(child, length, "%s/%s", path, entry->d_name);
+      ok = stat(child, &st) == 0;
+      bool added = ok && S_ISREG(st.st_mode) && (ok = path_list_add(list, child));
+      if (!added) free(child);
+    }
+  }
+  closedir(directory);
+  qsort(list->paths + first, list->count - first, sizeof(char *), path_compare);
+  return ok;
+}
+
+void path_list_free(path_list_t *list) {
+  for (size_t i = 0; i < list->count; ++i) free(list->paths[i]);
+  free(list->paths);
+}
+
+/**
+ * Prints how the program should be invoked.
+ */
+void usage(const char *program) {
+  fprintf(stderr, "Usage: %s [--slice N | --shm NAME | --fd FD | --arrow PATH] < instance\n", program);
+  fprintf(stderr, "       %s [--threads N] [--pattern GLOB] PATH...\n", program);
+  fprintf(stderr, "  --slice N  solve in resumable slices of N bridges, by Kruskal without --cache or --components.\n");
+  fprintf(stderr, "  --shm NAME solve the binary instance in the POSIX shared-memory segment NAME.\n");
+  fprintf(stderr, "  --fd FD    solve the binary instance in the inherited file descriptor FD (e.g. a memfd).\n");
+  fprintf(stderr, "  --arrow PATH solve the from/to/cost/company columns of an Arrow IPC file.\n");
+  fprintf(stderr, "  --buffer-size BYTES  size of the input buffer, instead of sizing it from the input.\n");
+  fprintf(stderr, "  --engine kruskal|boruvka|kkt|buckets  the algorithm solving the instances read as text.\n");
+  fprintf(stderr, "  --ids dense|sparse|names  islands numbered from 1 to n, by any 64-bit numbers, or by names.\n");
+  fprintf(stderr, "  --components  only print the number of connected components of the instance on stdin.\n");
+  fprintf(stderr, "  --cache DIR  keep the answers in DIR, and answer the inputs found there without solving them.\n");
+  fprintf(stderr, "  --cache-size BYTES  the size of the cache, beyond which the answers used least recently go.\n");
+  fprintf(stderr, "  --forest PATH  write the positions of the bridges of the forest in the input to PATH.\n");
+  fprintf(stderr, "  --stats    print statistics about the solve on stderr.\n");
+  fprintf(stderr, "  --no-huge-pages  keep the union-find arrays off huge pages, e.g. to compare the TLB misses.\n");
+  fprintf(stderr, "  --pattern GLOB  only solve the files of the directories whose name matches GLOB.\n");
+  fprintf(stderr, "  --threads N  solve the files or directories, or the loops of an engine, on N threads.\n");
+}
+
+int main(int argc, char *argv[]) {
+  int slice = 0;
+  const char *shm = NULL;
+  int fd = -1;
+  const char *arrow = NULL;
+  bool stats = false;
+  bool components = false;
+  int threads = pool_default_threads();
+  path_list_t paths = {NULL, 0, 0};
+  int operands = 1;   // The paths are moved to argv[1] to argv[operands - 1], to expand them once --pattern is known.
+  for (int a = 1; a < argc; a++) {
+    if (strcmp(argv[a], "--slice") == 0 && a + 1 < argc) {
+      slice = atoi(argv[++a]);
+    } else if (strcmp(argv[a], "--shm") == 0 && a + 1 < argc) {
+      shm = argv[++a];
+    } else if (strcmp(argv[a], "--fd") == 0 && a + 1 < argc) {
+      fd = atoi(argv[++a]);
+    } else if (strcmp(argv[a], "--arrow") == 0 && a + 1 < argc) {
+      arrow = argv[++a];
+    } else if (strcmp(argv[a], "--buffer-size") == 0 && a + 1 < argc) {
+      scan_buffer_size = (size_t) strtoull(argv[++a], NULL, 10);
+    } else if (strcmp(argv[a], "--engine") == 0 && a + 1 < argc && strcmp(argv[a + 1], "kruskal") == 0) {
+      solver_engine = ENGINE_KRUSKAL;
+      a++;
+    } else if (strcmp(argv[a], "--engine") == 0 && a + 1 < argc && strcmp(argv[a + 1], "boruvka") == 0) {
+      solver_engine = ENGINE_BORUVKA;
+      a++;
+    } else if (strcmp(argv[a], "--engine") == 0 && a + 1 < argc && strcmp(argv[a + 1], "kkt") == 0) {
+      solver_engine = ENGINE_KKT;
+      a++;
+    } else if (strcmp(argv[a], "--engine") == 0 && a + 1 < argc && strcmp(argv[a + 1], "buckets") == 0) {
+      solver_engine = ENGINE_BUCKETS;
+      a++;
+    } else if (strcmp(argv[a], "--cache") == 0 && a + 1 < argc) {
+      result_cache_dir = argv[++a];
+      scan_hashing = true;
+    } else if (strcmp(argv[a], "--cache-size") == 0 && a + 1 < argc) {
+      result_cache_size = (size_t) strtoull(argv[++a], NULL, 10);
+    } else if (strcmp(argv[a], "--forest") == 0 && a + 1 < argc) {
+      forest_path = argv[++a];
+    } else if (strcmp(argv[a], "--stats") == 0) {
+      stats = true;
+    } else if (strcmp(argv[a], "--no-huge-pages") == 0) {
+      uf_huge_pages = false;
+    } else if (strcmp(argv[a], "--ids") == 0 && a + 1 < argc && strcmp(argv[a + 1], "dense") == 0) {
+      island_ids = ISLAND_IDS_DENSE;
+      a++;
+    } else if (strcmp(argv[a], "--ids") == 0 && a + 1 < argc && strcmp(argv[a + 1], "sparse") == 0) {
+      island_ids = ISLAND_IDS_SPARSE;
+      a++;
+    } else if (strcmp(argv[a], "--ids") == 0 && a + 1 < argc && strcmp(argv[a + 1], "names") == 0) {
+      island_ids = ISLAND_IDS_NAMES;
+      a++;
+    } else if (strcmp(argv[a], "--components") == 0) {
+      components = true;
+    } else if (strcmp(argv[a], "--pattern") == 0 && a + 1 < argc) {
+      path_pattern = argv[++a];
+    } else if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc) {
+      threads = atoi(argv[++a]);
+    } else if (argv[a][0] != '-') {
+      argv[operands++] = argv[a];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  for (int a = 1; a < operands; a++) {
+    if (!path_list_expand(&paths, argv[a])) {
+      fprintf(stderr, "Could not read %s.\n", argv[a]);
+      return 1;
+    }
+  }
+
+  // A batch or a component count has no single forest to write, and the slices only run Kruskal's algorithm, without
+  // the cache. The components are only counted for a text instance read from the standard input.
+  bool slicing_unsupported = slice > 0 && (solver_engine != ENGINE_KRUSKAL || result_cache_dir != NULL);
+  bool counting_unsupported = components && (paths.count > 0 || slice > 0 || arrow != NULL || shm != NULL || fd >= 0);
+  bool forest_unsupported = forest_path != NULL && (paths.count > 0 || components);
+  if (forest_unsupported || slicing_unsupported || counting_unsupported) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  answer_t answer;
+  int tlb_counter = stats ? uf_tlb_counter_open() : -1;
+  if (result_cache_dir != NULL && mkdir(result_cache_dir, 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Could not create the cache directory %s.\n", result_cache_dir);
+    return 1;
+  }
+
+  if (paths.count > 0) {
+    pool_t pool;
+    if (!pool_init(&pool, threads)) {
+      fprintf(stderr, "Could not start the threads.\n");
+      return 1;
+    }
+    bool ok = batch_solve(&pool, paths.count, paths.paths);
+    pool_free(&pool);
+    base_cache_free();
+    path_list_free(&paths);
+    return ok ? 0 : 1;
+  }
+
+  if (arrow != NULL) {
+    if (!solve_arrow_file(arrow, &answer)) {
+      fprintf(stderr, "Could not solve the Arrow file %s.\n", arrow);
+      return 1;
+    }
+    answer_print(&answer, stdout);
+    return 0;
+  }
+
+  if (shm != NULL || fd >= 0) {
+    if (shm != NULL) fd = shm_open(shm, O_RDONLY, 0);
+    if (fd < 0 || !solve_records_fd(fd, &answer)) {
+      fprintf(stderr, "Could not solve the binary instance.\n");
+      return 1;
+    }
+    close(fd);
+    answer_print(&answer, stdout);
+    return 0;
+  }
+
+  if (slice > 0) {
+    solver_task_t *task = malloc(sizeof(solver_task_t));
+    solver_status_t status = SOLVER_FAILED;
+    if (task != NULL && solver_task_init(task, stdin)) {
+      while ((status = solver_task_step(task, slice)) == SOLVER_PENDING);
+    }
+    if (status == SOLVER_DONE) {
+      answer_print(&task->answer, stdout);
+      if (stats) scan_print_stats(&task->scanner, stderr);
+      if (stats) uf_print_stats(tlb_counter, stderr);
+    } else {
+      fprintf(stderr, "Could not solve the instance in slices.\n");
+    }
+    if (task != NULL) solver_task_free(task);
+    free(task);
+    return status == SOLVER_DONE ? 0 : 1;
+  }
+
+  // A single instance can use the threads inside its own solve.
+  pool_t pool;
+  if ((solver_engine != ENGINE_KRUSKAL || components) && threads > 1 && pool_init(&pool, threads)) {
+    solver_pool = &pool;
+  }
+
+  if (components) {
+    scanner_t scanner;
+    instance_t instance = {0, 0, NULL, NULL, false, NULL, NULL};
+    island_map_t islands = {0};
+    int count = -1;
+    if (scan_init(&scanner, stdin) && !scan_peek(&scanner, "delta") && instance_init(&instance, &scanner, NULL) &&
+        instance_map_islands(&instance, &islands) && instance_parse(&instance, &scanner, 0, instance.m)) {
+      count = components_count(solver_pool, instance.n, instance.m, instance.bridges);
+    }
+    if (count >= 0) {
+      printf("%d %s\n", count, count <= 1 ? "connected" : "disconnected");
+      if (stats) scan_print_stats(&scanner, stderr);
+    } else {
+      fprintf(stderr, "Could not count the components of the instance.\n");
+    }
+    scan_free(&scanner);
+    instance_free(&instance);
+    island_map_free(&islands);
+    if (solver_pool != NULL) pool_free(solver_pool);
+    return count >= 0 ? 0 : 1;
+  }
+
+  scanner_t scanner;
+  arena_t arena;
+  arena_init(&arena);
+  bool ok = scan_init(&scanner, stdin) && solve_scanner(&scanner, &arena, &answer);
+  if (ok) {
+    answer_print(&answer, stdout);
+    if (stats) scan_print_stats(&scanner, stderr);
+    if (stats) uf_print_stats(tlb_counter, stderr);
+  } else {
+    fprintf(stderr, "Could not solve the instance.\n");
+  }
+  scan_free(&scanner);
+  arena_free(&arena);
+  base_cache_free();
+  if (solver_pool != NULL) pool_free(solver_pool);
+  return ok ? 0 : 1;
 }
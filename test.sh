@@ -14,4 +14,24 @@ diff -u ./data/02.a <(./build/ex3 < ./data/02)
 diff -u ./data/03.a <(./build/ex3 < ./data/03)
 diff -u ./data/04.a <(./build/ex3 < ./data/04)
 diff -u ./data/05.a <(./build/ex3 < ./data/05)
+diff -u ./data/06.a <(./build/ex3 < ./data/06)
+diff -u ./data/07.a <(./build/ex3 < ./data/07)
+diff -u ./data/08.a <(./build/ex3 < ./data/08)
+diff -u ./data/05.a <(./build/ex3 --slice 7 < ./data/05)
+diff -u ./data/04.a <(./build/ex3 --engine boruvka --threads 2 < ./data/04)
+diff -u ./data/04.a <(./build/ex3 --engine kkt < ./data/04)
+diff -u ./data/06.a <(./build/ex3 --engine buckets < ./data/06)
+diff -u <(printf '1\n2\n4\n2 10\n') <(./build/ex3 --forest /dev/stdout < ./data/01)
+diff -u <(printf '1\n2\n4\n2 10\n') <(./build/ex3 --engine kkt --forest /dev/stdout < ./data/01)
+diff -u <(echo "23 disconnected") <(./build/ex3 --components --threads 2 < ./data/04)
+diff -u <(echo "5 4") <(printf '3 3\n18446744073709551615 42 5 red\n42 7 3 blue\n7 18446744073709551615 4 blue\n' | ./build/ex3 --ids sparse)
+diff -u <(echo "5 4") <(printf '3 3\nKorcula Hvar-North 5 red\nHvar-North Vis 3 blue\nVis Korcula 4 blue\n' | ./build/ex3 --ids names)
+diff -u <(echo "5 4") <(printf '3 3\nKorcula Hvar-North 5 red\nHvar-North Vis 3 blue\nVis Korcula 4 blue\n' | ./build/ex3 --ids names --slice 2)
+diff -u ./data/06.a <(./build/ex3 --cache ./build/cache < ./data/06)
+diff -u ./data/06.a <(./build/ex3 --cache ./build/cache < ./data/06)
+diff -u ./data/04.a <(./build/ex3 --fd 3 3< ./data/04.bin)
+diff -u ./data/05.a <(./build/ex3 --arrow ./data/05.arrow)
+cp ./data/05.arrow ./build/width.arrow && printf '\x18' | dd of=./build/width.arrow bs=1 seek=4108 conv=notrunc 2> /dev/null
+diff -u <(echo "Could not solve the Arrow file ./build/width.arrow.") <(./build/ex3 --arrow ./build/width.arrow 2>&1)
+diff -u <(cat ./data/*.a) <(./build/ex3 --threads 4 --pattern '[0-9][0-9]' ./data)
 echo "--- DONE ! ---"